@@ -0,0 +1,232 @@
+#include "board.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#if defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+using namespace std;
+
+void Board::reset(int numRows, int numCols)
+{
+    rows = numRows;
+    cols = numCols;
+    // whole words per row, so rows never share a word and shifts never cross rows
+    wordsPerRow = (cols + 63) / 64;
+    colors.assign(rows * cols, 0);
+    flags.assign(rows * cols, kEnabled);
+    bubbleSteps.assign(rows * cols, 0);
+    for (int c = 0; c < kNumColors; ++c)
+    {
+        matchable[c].assign(rows * wordsPerRow, 0);
+    }
+    for (int n = 0; n < rows * cols; ++n)
+    {
+        assign(n, 0, kEnabled);
+    }
+}
+
+void Board::assign(int n, uint8_t color, uint8_t cellFlags)
+{
+    int i = n / cols, j = n % cols;
+    uint64_t bit = 1ull << (j & 63);
+    size_t word = i * wordsPerRow + (j >> 6);
+
+    matchable[colors[n]][word] &= ~bit;
+    colors[n] = color;
+    flags[n] = cellFlags;
+    if ((cellFlags & (kEnabled | kSelected | kMatched)) == kEnabled)
+    {
+        matchable[color][word] |= bit;
+    }
+}
+
+void Board::syncMasks(int n)
+{
+    int i = n / cols, j = n % cols;
+    uint64_t bit = 1ull << (j & 63);
+    size_t word = i * wordsPerRow + (j >> 6);
+
+    for (int c = 0; c < kNumColors; ++c)
+    {
+        matchable[c][word] &= ~bit;
+    }
+    if ((flags[n] & (kEnabled | kSelected | kMatched)) == kEnabled)
+    {
+        matchable[colors[n]][word] |= bit;
+    }
+}
+
+namespace
+{
+
+/// out[k] |= a[k] & b[k] & c[k] for all three outs, i.e. marks the vertical
+/// runs starting in row a. Wide boards do 4 (AVX2) or 2 (SSE2) words at a time.
+void markVerticalRuns(const uint64_t* a, const uint64_t* b, const uint64_t* c,
+                      uint64_t* outA, uint64_t* outB, uint64_t* outC, int words)
+{
+    int k = 0;
+#if defined(__AVX2__)
+    for (; k + 4 <= words; k += 4)
+    {
+        __m256i start = _mm256_and_si256(_mm256_loadu_si256((const __m256i*) (a + k)),
+                        _mm256_and_si256(_mm256_loadu_si256((const __m256i*) (b + k)),
+                                         _mm256_loadu_si256((const __m256i*) (c + k))));
+        _mm256_storeu_si256((__m256i*) (outA + k), _mm256_or_si256(_mm256_loadu_si256((const __m256i*) (outA + k)), start));
+        _mm256_storeu_si256((__m256i*) (outB + k), _mm256_or_si256(_mm256_loadu_si256((const __m256i*) (outB + k)), start));
+        _mm256_storeu_si256((__m256i*) (outC + k), _mm256_or_si256(_mm256_loadu_si256((const __m256i*) (outC + k)), start));
+    }
+#endif
+#if defined(__SSE2__)
+    for (; k + 2 <= words; k += 2)
+    {
+        __m128i start = _mm_and_si128(_mm_loadu_si128((const __m128i*) (a + k)),
+                        _mm_and_si128(_mm_loadu_si128((const __m128i*) (b + k)),
+                                      _mm_loadu_si128((const __m128i*) (c + k))));
+        _mm_storeu_si128((__m128i*) (outA + k), _mm_or_si128(_mm_loadu_si128((const __m128i*) (outA + k)), start));
+        _mm_storeu_si128((__m128i*) (outB + k), _mm_or_si128(_mm_loadu_si128((const __m128i*) (outB + k)), start));
+        _mm_storeu_si128((__m128i*) (outC + k), _mm_or_si128(_mm_loadu_si128((const __m128i*) (outC + k)), start));
+    }
+#endif
+    for (; k < words; ++k)
+    {
+        uint64_t start = a[k] & b[k] & c[k];
+        outA[k] |= start;
+        outB[k] |= start;
+        outC[k] |= start;
+    }
+}
+
+/// Bit j set where cells j, j+1 and j+2 of the row are all set; bits of the
+/// next word shift in from the top
+inline uint64_t horizontalRunStarts(const uint64_t* row, int k, int words)
+{
+    uint64_t m = row[k];
+    uint64_t next = k + 1 < words ? row[k + 1] : 0;
+    return m & ((m >> 1) | (next << 63)) & ((m >> 2) | (next << 62));
+}
+
+} // namespace
+
+void FindRuns(const Board& board, vector<uint64_t>& runs)
+{
+    const int words = board.wordsPerRow;
+    runs.assign(board.rows * words, 0);
+
+    for (int c = 0; c < kNumColors; ++c)
+    {
+        const uint64_t* m = board.matchable[c].data();
+
+        for (int i = 0; i < board.rows; ++i)
+        {
+            const uint64_t* row = m + i * words;
+            uint64_t* out = runs.data() + i * words;
+            uint64_t previous = 0; // starts of the word below, whose runs reach into this one
+            for (int k = 0; k < words; ++k)
+            {
+                uint64_t start = horizontalRunStarts(row, k, words);
+                out[k] |= start | (start << 1) | (start << 2) | (previous >> 63) | (previous >> 62);
+                previous = start;
+            }
+        }
+
+        for (int i = 0; i + 2 < board.rows; ++i)
+        {
+            markVerticalRuns(m + i * words, m + (i + 1) * words, m + (i + 2) * words,
+                             runs.data() + i * words, runs.data() + (i + 1) * words,
+                             runs.data() + (i + 2) * words, words);
+        }
+    }
+}
+
+void FindRunsReference(const Board& board, vector<uint64_t>& runs)
+{
+    const int words = board.wordsPerRow;
+    runs.assign(board.rows * words, 0);
+
+    auto matchable = [&](int i, int j) {
+        return (board.flags[board.index(i, j)] & (kEnabled | kSelected | kMatched)) == kEnabled;
+    };
+    auto mark = [&](int i, int j) {
+        runs[i * words + (j >> 6)] |= 1ull << (j & 63);
+    };
+
+    for (int i = 0; i < board.rows; ++i)
+    {
+        for (int j = 0; j < board.cols; )
+        {
+            int end = j + 1;
+            while (matchable(i, j) && end < board.cols && matchable(i, end) &&
+                   board.colors[board.index(i, end)] == board.colors[board.index(i, j)])
+            {
+                ++end;
+            }
+            if (end - j >= 3)
+            {
+                for (int k = j; k < end; ++k) mark(i, k);
+            }
+            j = end;
+        }
+    }
+
+    for (int j = 0; j < board.cols; ++j)
+    {
+        for (int i = 0; i < board.rows; )
+        {
+            int end = i + 1;
+            while (matchable(i, j) && end < board.rows && matchable(end, j) &&
+                   board.colors[board.index(end, j)] == board.colors[board.index(i, j)])
+            {
+                ++end;
+            }
+            if (end - i >= 3)
+            {
+                for (int k = i; k < end; ++k) mark(k, j);
+            }
+            i = end;
+        }
+    }
+}
+
+void BenchmarkMatch()
+{
+    const int sizes[] = { 64, 256, 1024, 4096 };
+    const uint8_t colors[] = { 0, 1, 3 };
+
+    printf("   grid     scalar ms  bitboard ms   speedup  mismatched words\n");
+    for (int n : sizes)
+    {
+        // a few locked cells so the flag handling is exercised too
+        Board board;
+        board.reset(n, n);
+        srand(n);
+        for (int c = 0; c < n * n; ++c)
+        {
+            int r = rand() % 100;
+            uint8_t cellFlags = r < 2 ? kEnabled | kSelected : r < 5 ? kEnabled | kMatched : r < 6 ? 0 : kEnabled;
+            board.assign(c, colors[rand() % 3], cellFlags);
+        }
+
+        // repeat small boards so every measurement takes a while
+        int reps = max(1, (1 << 22) / (n * n));
+        vector<uint64_t> reference, runs;
+
+        auto start = chrono::steady_clock::now();
+        for (int r = 0; r < reps; ++r) FindRunsReference(board, reference);
+        double scalarMs = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count() / reps;
+
+        start = chrono::steady_clock::now();
+        for (int r = 0; r < reps; ++r) FindRuns(board, runs);
+        double bitboardMs = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count() / reps;
+
+        size_t mismatches = 0;
+        for (size_t w = 0; w < runs.size(); ++w)
+        {
+            mismatches += runs[w] != reference[w];
+        }
+        printf("%4dx%-4d %11.3f %12.3f %9.1f %17zu\n", n, n, scalarMs, bitboardMs, scalarMs / bitboardMs, mismatches);
+    }
+}
@@ -0,0 +1,70 @@
+#ifndef BOARD_H
+#define BOARD_H
+
+#include <cstdint>
+#include <vector>
+
+/// Colors are gProgram slots 0, 1 and 3; slot 2 (text) never appears on the board
+const int kNumColors = 4;
+
+enum CellFlags : uint8_t
+{
+    kEnabled = 1,
+    kSelected = 2,  // clicked, shrinking away
+    kMatched = 4,   // part of a run, bubbling
+};
+
+/// The game board as structure of arrays, all row-major with index i * cols + j.
+/// Besides the packed color plane it keeps one bitmask per color and row of
+/// the cells that can take part in a run (enabled, neither selected nor
+/// matched), so runs can be found 64 cells at a time. Cells must be changed
+/// through assign() and setFlags() to keep the masks in sync.
+struct Board
+{
+    int rows = 0, cols = 0;
+    int wordsPerRow = 0;
+    std::vector<uint8_t> colors;
+    std::vector<uint8_t> flags;
+    std::vector<uint16_t> bubbleSteps; // steps spent bubbling since matched
+    std::vector<uint64_t> matchable[kNumColors]; // bit j % 64 of word i * wordsPerRow + j / 64
+
+    /// rows x cols enabled cells of color 0
+    void reset(int numRows, int numCols);
+
+    int index(int i, int j) const { return i * cols + j; }
+    bool has(int n, uint8_t flag) const { return (flags[n] & flag) != 0; }
+    bool isMatchable(int i, int j, int color) const
+    {
+        return (matchable[color][i * wordsPerRow + (j >> 6)] >> (j & 63)) & 1;
+    }
+
+    void assign(int n, uint8_t color, uint8_t cellFlags);
+    void setFlags(int n, uint8_t cellFlags) { assign(n, colors[n], cellFlags); }
+
+    /// Copies cell from over cell to without touching the masks, which
+    /// several columns share. Call syncMasks on every changed cell afterwards.
+    void moveCellUnsynced(int from, int to)
+    {
+        colors[to] = colors[from];
+        flags[to] = flags[from];
+        bubbleSteps[to] = bubbleSteps[from];
+    }
+
+    /// Recomputes cell n's bit in all color masks
+    void syncMasks(int n);
+};
+
+/// Sets the bit (same layout as Board::matchable) of every cell that is part
+/// of a horizontal or vertical run of three or more matchable cells of one
+/// color. Works on the bitmasks: a run starts wherever m & m>>1 & m>>2 is set
+/// within a row and wherever three consecutive rows AND to non-zero.
+void FindRuns(const Board& board, std::vector<uint64_t>& runs);
+
+/// Same result as FindRuns, one cell at a time on the color and flag planes
+void FindRunsReference(const Board& board, std::vector<uint64_t>& runs);
+
+/// Times FindRunsReference and FindRuns on random boards up to 4096x4096,
+/// checks that they agree and prints the results.
+void BenchmarkMatch();
+
+#endif
@@ -0,0 +1,120 @@
+#include "file_util.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <climits>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace std;
+
+string gCacheDir = ".cache";
+bool gCacheEnabled = true;
+
+bool MappedFile::open(const string& fileName)
+{
+    close();
+
+    int fd = ::open(fileName.c_str(), O_RDONLY);
+    if (fd < 0)
+    {
+        return false;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0)
+    {
+        ::close(fd);
+        return false;
+    }
+
+    size = st.st_size;
+    if (size > 0)
+    {
+        void* p = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (p == MAP_FAILED)
+        {
+            ::close(fd);
+            size = 0;
+            return false;
+        }
+        madvise(p, size, MADV_SEQUENTIAL);
+        data = (const char*) p;
+    }
+
+    ::close(fd); // the mapping stays valid after the descriptor is closed
+    return true;
+}
+
+void MappedFile::close()
+{
+    if (data)
+    {
+        munmap((void*) data, size);
+    }
+    data = nullptr;
+    size = 0;
+}
+
+bool GetFileKey(const string& fileName, FileKey& key)
+{
+    struct stat st;
+    if (stat(fileName.c_str(), &st) != 0)
+    {
+        return false;
+    }
+
+    char resolved[PATH_MAX];
+    key.path = realpath(fileName.c_str(), resolved) ? resolved : fileName;
+    key.size = st.st_size;
+    key.mtimeNs = (int64_t) st.st_mtim.tv_sec * 1000000000 + st.st_mtim.tv_nsec;
+    return true;
+}
+
+uint64_t HashBytes(const void* data, size_t size, uint64_t seed)
+{
+    const unsigned char* p = (const unsigned char*) data;
+    uint64_t h = seed;
+    for (size_t i = 0; i < size; ++i)
+    {
+        h ^= p[i];
+        h *= 1099511628211ull;
+    }
+    return h;
+}
+
+string CacheFilePath(const string& prefix, uint64_t hash, const string& suffix)
+{
+    mkdir(gCacheDir.c_str(), 0755); // fails harmlessly if it already exists
+
+    char hex[17];
+    snprintf(hex, sizeof(hex), "%016llx", (unsigned long long) hash);
+    return gCacheDir + "/" + prefix + "-" + hex + suffix;
+}
+
+bool WriteFileAtomic(const string& fileName, const void* const* parts, const size_t* sizes, int numParts)
+{
+    string tmpName = fileName + ".tmp" + to_string(getpid());
+
+    FILE* f = fopen(tmpName.c_str(), "wb");
+    if (!f)
+    {
+        return false;
+    }
+
+    bool ok = true;
+    for (int i = 0; i < numParts && ok; ++i)
+    {
+        ok = sizes[i] == 0 || fwrite(parts[i], 1, sizes[i], f) == sizes[i];
+    }
+    ok = (fclose(f) == 0) && ok;
+
+    if (!ok || rename(tmpName.c_str(), fileName.c_str()) != 0)
+    {
+        remove(tmpName.c_str());
+        return false;
+    }
+    return true;
+}
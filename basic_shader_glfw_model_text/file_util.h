@@ -0,0 +1,49 @@
+#ifndef FILE_UTIL_H
+#define FILE_UTIL_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+/// Read-only view of a whole file mapped into memory
+struct MappedFile
+{
+    const char* data = nullptr;
+    size_t size = 0;
+
+    MappedFile() { }
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+    ~MappedFile() { close(); }
+
+    bool open(const std::string& fileName);
+    void close();
+};
+
+/// What a cache entry derived from a source file is keyed on
+struct FileKey
+{
+    std::string path;   // canonical absolute path
+    uint64_t size = 0;
+    int64_t mtimeNs = 0;
+};
+
+/// Fills key for fileName. Returns false if the file does not exist.
+bool GetFileKey(const std::string& fileName, FileKey& key);
+
+/// 64-bit FNV-1a; pass a previous result as seed to hash several pieces
+uint64_t HashBytes(const void* data, size_t size, uint64_t seed = 14695981039346656037ull);
+
+/// Directory holding all on-disk caches, relative to the working directory
+extern std::string gCacheDir;
+/// Set to false (--no-cache) to neither read nor write any cache
+extern bool gCacheEnabled;
+
+/// Returns gCacheDir/<prefix>-<hash as hex><suffix>, creating gCacheDir if needed
+std::string CacheFilePath(const std::string& prefix, uint64_t hash, const std::string& suffix);
+
+/// Writes the given pieces to a temporary file and renames it over fileName,
+/// so that readers never observe a half-written cache entry.
+bool WriteFileAtomic(const std::string& fileName, const void* const* parts, const size_t* sizes, int numParts);
+
+#endif
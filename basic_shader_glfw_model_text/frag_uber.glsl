@@ -0,0 +1,16 @@
+#version 120
+
+// Materials, shade() and the varyings come with material.glsl
+
+void main(void)
+{
+	Material m = materials[int(fragMaterial + 0.5)];
+	if (m.shading < 0.5)
+	{
+		gl_FragColor = vec4(vertexColor, 1);
+	}
+	else
+	{
+		gl_FragColor = vec4(shade(m, vec3(fragPos), N), 1);
+	}
+}
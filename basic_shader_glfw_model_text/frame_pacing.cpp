@@ -0,0 +1,246 @@
+#include "frame_pacing.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+#include <GLFW/glfw3.h>
+
+using namespace std;
+
+bool ParsePacingMode(const string& text, PacingMode& mode, double& capFps)
+{
+    if (text == "uncapped") mode = kPacingUncapped;
+    else if (text == "vsync") mode = kPacingVsync;
+    else if (text == "adaptive") mode = kPacingAdaptive;
+    else
+    {
+        char* end = nullptr;
+        double fps = strtod(text.c_str(), &end);
+        if (end == text.c_str() || *end || !(fps > 0))
+        {
+            return false;
+        }
+        mode = kPacingCapped;
+        capFps = fps;
+    }
+    return true;
+}
+
+int FrameHistogram::bucket(double ms)
+{
+    return min(max((int) (ms / kBucketMs), 0), kBuckets - 1);
+}
+
+void FrameHistogram::add(double ms)
+{
+    if ((int) samples.size() < kWindow)
+    {
+        samples.push_back(ms);
+    }
+    else
+    {
+        --counts[bucket(samples[next])];
+        sumMs -= samples[next];
+        samples[next] = ms;
+        next = (next + 1) % kWindow;
+    }
+    ++counts[bucket(ms)];
+    sumMs += ms;
+}
+
+double FrameHistogram::percentile(double p) const
+{
+    int rank = max((int) (p / 100 * samples.size() + 0.5), 1);
+    int seen = 0;
+    for (int b = 0; b < kBuckets - 1; ++b)
+    {
+        seen += counts[b];
+        if (seen >= rank) return (b + 1) * kBucketMs;
+    }
+    // the last bucket has no upper edge
+    return *max_element(samples.begin(), samples.end());
+}
+
+void FrameHistogram::print(const char* name) const
+{
+    if (samples.empty())
+    {
+        printf("%s: no frames\n", name);
+        return;
+    }
+    float maxMs = *max_element(samples.begin(), samples.end());
+    printf("%s ms, last %d frames: mean %.3f  p50 <= %.1f  p95 <= %.1f  p99 <= %.1f  max %.3f\n", name, count(),
+           sumMs / count(), percentile(50), percentile(95), percentile(99), maxMs);
+
+    int largest = *max_element(counts, counts + kBuckets);
+    for (int b = 0; b < kBuckets; ++b)
+    {
+        if (!counts[b]) continue;
+        // scaled so the fullest bucket gets 50
+        int bar = max(counts[b] * 50 / largest, 1);
+        if (b == kBuckets - 1) printf("  %5.1f+      ", b * kBucketMs);
+        else printf("  %5.1f-%-5.1f ", b * kBucketMs, (b + 1) * kBucketMs);
+        printf("%5d %s\n", counts[b], string(bar, '#').c_str());
+    }
+}
+
+void FramePacer::setMode(PacingMode newMode, double newCapFps)
+{
+    pacingMode = newMode;
+    capFps = newCapFps;
+
+    int interval = pacingMode == kPacingVsync ? 1 : 0;
+    if (pacingMode == kPacingAdaptive)
+    {
+        if (glfwExtensionSupported("GLX_EXT_swap_control_tear") || glfwExtensionSupported("WGL_EXT_swap_control_tear"))
+        {
+            interval = -1;
+        }
+        else
+        {
+            printf("Adaptive vsync is not supported here, using vsync\n");
+            pacingMode = kPacingVsync;
+            interval = 1;
+        }
+    }
+    glfwSwapInterval(interval);
+    nextFrame = Clock::now();
+}
+
+string FramePacer::modeName() const
+{
+    switch (pacingMode)
+    {
+    case kPacingUncapped: return "uncapped";
+    case kPacingVsync: return "vsync";
+    case kPacingAdaptive: return "adaptive vsync";
+    case kPacingCapped:
+        char capped[32];
+        snprintf(capped, sizeof(capped), "capped at %g fps", capFps);
+        return capped;
+    }
+    return "";
+}
+
+void FramePacer::start()
+{
+    timerQueries = GLEW_VERSION_3_3 || GLEW_ARB_timer_query;
+    if (timerQueries)
+    {
+        glGenQueries(kQueries, queries);
+    }
+    started = false;
+    animationSeconds = 0;
+    firstQuery = frameIndex % kQueries;
+    nextFrame = Clock::now();
+}
+
+void FramePacer::stop()
+{
+    if (timerQueries && queries[0])
+    {
+        // whatever has finished still counts
+        collectQueries();
+        glDeleteQueries(kQueries, queries);
+        fill(queries, queries + kQueries, 0);
+        fill(pending, pending + kQueries, false);
+    }
+}
+
+void FramePacer::collectQueries()
+{
+    for (int q = 0; q < kQueries; ++q)
+    {
+        if (!pending[q]) continue;
+
+        GLint available = GL_FALSE;
+        glGetQueryObjectiv(queries[q], GL_QUERY_RESULT_AVAILABLE, &available);
+        if (!available) continue;
+
+        GLuint64 ns = 0;
+        glGetQueryObjectui64v(queries[q], GL_QUERY_RESULT, &ns);
+        pending[q] = false;
+        if (q == firstQuery)
+        {
+            // llvmpipe returns a timestamp rather than a duration for it
+            firstQuery = -1;
+            continue;
+        }
+        gpuMs.add(ns / 1e6);
+    }
+}
+
+void FramePacer::beginFrame()
+{
+    if (pacingMode == kPacingCapped)
+    {
+        const Clock::duration period = chrono::duration_cast<Clock::duration>(chrono::duration<double>(1 / capFps));
+        this_thread::sleep_until(nextFrame);
+        nextFrame += period;
+        // a frame that ran long moves the schedule instead of making the next ones rush
+        if (Clock::now() > nextFrame)
+        {
+            nextFrame = Clock::now() + period;
+        }
+    }
+
+    Clock::time_point now = Clock::now();
+    if (started)
+    {
+        double seconds = chrono::duration<double>(now - frameStart).count();
+        intervalMs.add(seconds * 1000);
+        animationSeconds += min(seconds, kMaxStepSeconds);
+    }
+    started = true;
+    frameStart = now;
+
+    if (timerQueries)
+    {
+        collectQueries();
+        int q = frameIndex % kQueries;
+        if (pending[q])
+        {
+            // the GPU is kQueries frames behind; reading this one would wait for it
+            ++unmeasuredGpuFrames;
+        }
+        else
+        {
+            glBeginQuery(GL_TIME_ELAPSED, queries[q]);
+        }
+    }
+}
+
+void FramePacer::endFrame()
+{
+    if (timerQueries)
+    {
+        int q = frameIndex % kQueries;
+        if (!pending[q])
+        {
+            glEndQuery(GL_TIME_ELAPSED);
+            pending[q] = true;
+        }
+    }
+    ++frameIndex;
+    cpuMs.add(chrono::duration<double, milli>(Clock::now() - frameStart).count());
+}
+
+void FramePacer::printStats() const
+{
+    printf("Frame pacing: %s\n", modeName().c_str());
+    intervalMs.print("Frame interval");
+    cpuMs.print("CPU frame");
+    if (timerQueries)
+    {
+        gpuMs.print("GPU frame");
+        if (unmeasuredGpuFrames)
+        {
+            printf("  %d frames not measured, the GPU was %d frames behind\n", unmeasuredGpuFrames, kQueries);
+        }
+    }
+    else
+    {
+        printf("GPU frame: no GL_TIME_ELAPSED queries\n");
+    }
+}
@@ -0,0 +1,110 @@
+#ifndef FRAME_PACING_H
+#define FRAME_PACING_H
+
+#include <chrono>
+#include <string>
+#include <vector>
+#include <GL/glew.h>
+
+/// How frames are handed to the display
+enum PacingMode
+{
+    kPacingUncapped, // swap interval 0, as fast as the frames are made
+    kPacingVsync,    // swap interval 1
+    kPacingAdaptive, // swap interval -1: vsync, but a late frame is shown at once (tearing) instead of a refresh later
+    kPacingCapped,   // swap interval 0, and the loop sleeps to a fixed frame rate
+};
+
+/// "uncapped", "vsync", "adaptive", or a frame rate such as "30" for a cap
+bool ParsePacingMode(const std::string& text, PacingMode& mode, double& capFps);
+
+/// Frame times of the last kWindow frames in buckets of kBucketMs. Adding a
+/// frame drops the oldest, so the counts always describe recent frames.
+class FrameHistogram
+{
+public:
+    static constexpr double kBucketMs = 0.5;
+    static const int kBuckets = 200; // the last one also holds everything slower
+    static const int kWindow = 1000;
+
+    void add(double ms);
+    int count() const { return (int) samples.size(); }
+
+    /// Upper edge of the bucket up to which p percent of the frames lie, or
+    /// the slowest frame when that is the last bucket
+    double percentile(double p) const;
+
+    /// Summary line, then one line per non-empty bucket
+    void print(const char* name) const;
+
+private:
+    static int bucket(double ms);
+
+    std::vector<float> samples; // ring of the last kWindow frames
+    int next = 0;
+    int counts[kBuckets] = {};
+    double sumMs = 0;
+};
+
+/// Sets the swap interval, sleeps to a frame rate cap, and measures the
+/// frames of the window loop: the interval between frames, the CPU time
+/// from beginFrame to endFrame and, with GL_TIME_ELAPSED queries, the GPU
+/// time of the same commands. Query results are read a few frames late,
+/// once available, so measuring never waits for the GPU.
+class FramePacer
+{
+public:
+    /// Longest step animationTime() takes, so a stall doesn't make things jump
+    static constexpr double kMaxStepSeconds = 0.1;
+
+    ~FramePacer() { stop(); }
+
+    /// Applies mode to the swap interval of the current context. Adaptive
+    /// falls back to vsync where the driver can't tear.
+    void setMode(PacingMode newMode, double newCapFps);
+    PacingMode mode() const { return pacingMode; }
+    std::string modeName() const;
+
+    /// Creates the queries and starts the clocks; the context must be current
+    void start();
+    /// Deletes the queries, keeping the results of those that finished
+    void stop();
+
+    /// Sleeps until the cap allows the next frame, if capped, then starts
+    /// timing it
+    void beginFrame();
+    /// Call after the frame's commands, before swapping buffers
+    void endFrame();
+
+    /// Seconds of animation at the frame being made: the time since
+    /// start() with every step clamped to kMaxStepSeconds
+    double animationTime() const { return animationSeconds; }
+
+    /// The histograms of interval, CPU and GPU time
+    void printStats() const;
+
+private:
+    typedef std::chrono::steady_clock Clock;
+    static const int kQueries = 4; // frames the GPU may fall behind before one goes unmeasured
+
+    void collectQueries();
+
+    PacingMode pacingMode = kPacingVsync;
+    double capFps = 60;
+
+    Clock::time_point frameStart;
+    Clock::time_point nextFrame; // capped: when the next frame may start
+    bool started = false;
+    double animationSeconds = 0;
+
+    bool timerQueries = false;
+    GLuint queries[kQueries] = {};
+    bool pending[kQueries] = {};
+    int frameIndex = 0;
+    int firstQuery = -1; // of the first frame after start(), whose result is not used
+    int unmeasuredGpuFrames = 0;
+
+    FrameHistogram intervalMs, cpuMs, gpuMs;
+};
+
+#endif
@@ -0,0 +1,153 @@
+#include "gl_state.h"
+
+#include <cassert>
+#include <vector>
+
+using namespace std;
+
+FrameStats gFrameStats;
+FrameStats gLastFrameStats;
+
+namespace
+{
+
+vector<ProgramUniforms> gRegisteredPrograms;
+
+/// What was last passed to glVertexAttribPointer for one attribute index
+struct AttribPointer
+{
+    bool valid = false;
+    GLuint buffer;
+    GLint size;
+    GLenum type;
+    GLboolean normalized;
+    GLsizei stride;
+    const void* pointer;
+};
+
+const int kMaxTrackedAttribs = 16;
+
+// 0 is a valid program/buffer name, so track validity separately
+bool gProgramValid = false;
+GLuint gCurrentProgram;
+bool gArrayBufferValid = false;
+GLuint gArrayBuffer;
+bool gElementBufferValid = false;
+GLuint gElementBuffer;
+AttribPointer gAttribs[kMaxTrackedAttribs];
+
+} // namespace
+
+void RegisterProgram(GLuint program)
+{
+    ProgramUniforms u;
+    u.program = program;
+    u.modelingMat = glGetUniformLocation(program, "modelingMat");
+    u.modelingMatInvTr = glGetUniformLocation(program, "modelingMatInvTr");
+    u.orthoMat = glGetUniformLocation(program, "orthoMat");
+    u.intensity = glGetUniformLocation(program, "intensity");
+    u.projection = glGetUniformLocation(program, "projection");
+    u.textColor = glGetUniformLocation(program, "textColor");
+    u.positionOffset = glGetUniformLocation(program, "positionOffset");
+    u.positionScale = glGetUniformLocation(program, "positionScale");
+    u.materialId = glGetUniformLocation(program, "materialId");
+
+    for (ProgramUniforms& p : gRegisteredPrograms)
+    {
+        if (p.program == program)
+        {
+            p = u;
+            return;
+        }
+    }
+    gRegisteredPrograms.push_back(u);
+}
+
+const ProgramUniforms& Uniforms(GLuint program)
+{
+    // a handful of programs, a linear scan beats any map
+    for (const ProgramUniforms& p : gRegisteredPrograms)
+    {
+        if (p.program == program)
+        {
+            return p;
+        }
+    }
+    assert(!"program was not registered");
+    static ProgramUniforms none;
+    return none;
+}
+
+void BeginFrameStats()
+{
+    gLastFrameStats = gFrameStats;
+    gFrameStats = FrameStats();
+}
+
+void UseProgram(GLuint program)
+{
+    if (gProgramValid && gCurrentProgram == program)
+    {
+        ++gFrameStats.avoidedCalls;
+        return;
+    }
+    glUseProgram(program);
+    gCurrentProgram = program;
+    gProgramValid = true;
+    ++gFrameStats.programSwitches;
+}
+
+void BindBuffer(GLenum target, GLuint buffer)
+{
+    if (target != GL_ARRAY_BUFFER && target != GL_ELEMENT_ARRAY_BUFFER)
+    {
+        glBindBuffer(target, buffer); // not tracked
+        return;
+    }
+
+    bool& valid = (target == GL_ARRAY_BUFFER) ? gArrayBufferValid : gElementBufferValid;
+    GLuint& bound = (target == GL_ARRAY_BUFFER) ? gArrayBuffer : gElementBuffer;
+    if (valid && bound == buffer)
+    {
+        ++gFrameStats.avoidedCalls;
+        return;
+    }
+    glBindBuffer(target, buffer);
+    bound = buffer;
+    valid = true;
+    ++gFrameStats.bufferBinds;
+}
+
+void SetVertexAttribPointer(GLuint index, GLint size, GLenum type, GLboolean normalized, GLsizei stride, const void* pointer)
+{
+    assert(index < kMaxTrackedAttribs && gArrayBufferValid);
+
+    // the pointer is relative to whatever is bound to GL_ARRAY_BUFFER
+    AttribPointer& a = gAttribs[index];
+    if (a.valid && a.buffer == gArrayBuffer && a.size == size && a.type == type &&
+        a.normalized == normalized && a.stride == stride && a.pointer == pointer)
+    {
+        ++gFrameStats.avoidedCalls;
+        return;
+    }
+    glVertexAttribPointer(index, size, type, normalized, stride, pointer);
+    a.valid = true;
+    a.buffer = gArrayBuffer;
+    a.size = size;
+    a.type = type;
+    a.normalized = normalized;
+    a.stride = stride;
+    a.pointer = pointer;
+    ++gFrameStats.attribPointerCalls;
+}
+
+void InvalidateGLState()
+{
+    gProgramValid = false;
+    gArrayBufferValid = false;
+    gElementBufferValid = false;
+    for (AttribPointer& a : gAttribs)
+    {
+        a.valid = false;
+    }
+}
@@ -0,0 +1,61 @@
+#ifndef GL_STATE_H
+#define GL_STATE_H
+
+#include <GL/glew.h>
+
+/// Uniform locations of one linked program, looked up once after linking.
+/// Uniforms a program does not have are -1, which glUniform* ignores.
+struct ProgramUniforms
+{
+    GLuint program = 0;
+    GLint modelingMat = -1;
+    GLint modelingMatInvTr = -1;
+    GLint orthoMat = -1;
+    GLint intensity = -1;
+    GLint projection = -1;
+    GLint textColor = -1;
+    GLint positionOffset = -1;
+    GLint positionScale = -1;
+    GLint materialId = -1;
+};
+
+/// Resolves and stores the uniform locations of program; call after glLinkProgram
+void RegisterProgram(GLuint program);
+
+/// Locations stored by RegisterProgram
+const ProgramUniforms& Uniforms(GLuint program);
+
+/// GL calls issued and skipped while drawing one frame
+struct FrameStats
+{
+    int drawCalls = 0;
+    int programSwitches = 0;
+    int bufferBinds = 0;
+    int attribPointerCalls = 0;
+    long meshTriangles = 0;  // submitted by the board draws, all instances
+    int avoidedCalls = 0;   // redundant glUseProgram/glBindBuffer/glVertexAttribPointer calls skipped
+};
+
+extern FrameStats gFrameStats;      // frame being drawn
+extern FrameStats gLastFrameStats;  // last completed frame
+
+/// Publishes gFrameStats as gLastFrameStats and starts counting a new frame
+void BeginFrameStats();
+
+/// These forward to the GL only when the call would change the current state
+void UseProgram(GLuint program);
+void BindBuffer(GLenum target, GLuint buffer);
+void SetVertexAttribPointer(GLuint index, GLint size, GLenum type, GLboolean normalized, GLsizei stride, const void* pointer);
+
+/// Counts a draw call in gFrameStats
+inline void CountDrawCall() { ++gFrameStats.drawCalls; }
+inline void CountDrawCall(long meshTriangles)
+{
+    ++gFrameStats.drawCalls;
+    gFrameStats.meshTriangles += meshTriangles;
+}
+
+/// Forgets the tracked state; call after changing it with raw GL calls
+void InvalidateGLState();
+
+#endif
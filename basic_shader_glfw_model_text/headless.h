@@ -0,0 +1,26 @@
+#ifndef HEADLESS_H
+#define HEADLESS_H
+
+#include <EGL/egl.h>
+#include <GL/glew.h>
+
+/// An OpenGL context without a window or display server: EGL on Mesa's
+/// surfaceless platform, which falls back to llvmpipe when there is no GPU.
+/// Everything is drawn into a framebuffer object instead of a back buffer.
+struct HeadlessContext
+{
+    EGLDisplay display = EGL_NO_DISPLAY;
+    EGLContext context = EGL_NO_CONTEXT;
+    GLuint framebuffer = 0;
+    GLuint renderbuffers[2] = { 0, 0 }; // color, depth + stencil
+
+    /// Creates the context and makes it current
+    bool create();
+
+    /// Creates and binds a width x height framebuffer; needs GLEW to be initialized
+    bool createFramebuffer(int width, int height);
+
+    void destroy();
+};
+
+#endif
@@ -0,0 +1,104 @@
+#include "index_buffer.h"
+
+#include <algorithm>
+
+using namespace std;
+
+namespace
+{
+
+const GLuint kMaxRangeVertices = 65536;
+const GLuint kWindowStep = kMaxRangeVertices / 2;
+
+inline GLuint lowest(const GLuint* t) { return min(t[0], min(t[1], t[2])); }
+inline GLuint highest(const GLuint* t) { return max(t[0], max(t[1], t[2])); }
+
+} // namespace
+
+void UseLongIndices(const GpuMesh& mesh, GpuIndices& indices)
+{
+    indices.type = GL_UNSIGNED_INT;
+    indices.shortIndexData = nullptr;
+    indices.shortIndexCount = 0;
+    indices.extraVertexData = nullptr;
+    indices.extraVertexCount = 0;
+    vector<GLushort>().swap(indices.shortIndexStorage);
+    vector<GLuint>().swap(indices.extraVertexStorage);
+    indices.ranges.clear();
+    for (int l = 0; l < mesh.lodCount; ++l)
+    {
+        indices.firstRange[l] = l;
+        indices.rangeCount[l] = 1;
+        indices.ranges.push_back({ mesh.lods[l].firstIndex, mesh.lods[l].indexCount, 0 });
+    }
+}
+
+void BuildGpuIndices(const GpuMesh& mesh, GpuIndices& indices, int maxRangesPerLevel)
+{
+    vector<GLushort>& shortIndices = indices.shortIndexStorage;
+    vector<GLuint>& extraVertices = indices.extraVertexStorage;
+    indices.type = GL_UNSIGNED_SHORT;
+    shortIndices.clear();
+    shortIndices.reserve(mesh.indexCount);
+    extraVertices.clear();
+    indices.ranges.clear();
+
+    // window w covers the 65536 vertices from w * step on; the last window
+    // starting at or below a triangle's lowest vertex reaches furthest.
+    // Small meshes need just the one.
+    GLuint step = (GLuint) mesh.vertexCount <= kMaxRangeVertices ? 0 : kWindowStep;
+    auto windowOf = [step](GLuint v) -> GLuint { return step ? v / step : 0; };
+
+    vector<GLuint> triangles;
+    vector<vector<GLuint>> windows;
+    for (int l = 0; l < mesh.lodCount; ++l)
+    {
+        const MeshLod& lod = mesh.lods[l];
+        indices.firstRange[l] = indices.ranges.size();
+
+        triangles.assign(mesh.indexData + lod.firstIndex, mesh.indexData + lod.firstIndex + lod.indexCount);
+        for (size_t k = 0; k < triangles.size(); k += 3)
+        {
+            GLuint* t = &triangles[k];
+            if (highest(t) >= windowOf(lowest(t)) * step + kMaxRangeVertices)
+            {
+                for (int c = 0; c < 3; ++c)
+                {
+                    extraVertices.push_back(t[c]);
+                    t[c] = mesh.vertexCount + extraVertices.size() - 1;
+                }
+            }
+        }
+
+        windows.assign(windowOf(mesh.vertexCount + extraVertices.size()) + 1, vector<GLuint>());
+        for (size_t k = 0; k < triangles.size(); k += 3)
+        {
+            const GLuint* t = &triangles[k];
+            vector<GLuint>& window = windows[windowOf(lowest(t))];
+            window.insert(window.end(), t, t + 3);
+        }
+
+        for (size_t w = 0; w < windows.size(); ++w)
+        {
+            if (windows[w].empty()) continue;
+
+            GLuint base = w * step;
+            indices.ranges.push_back({ (GLuint) shortIndices.size(), (GLuint) windows[w].size(), (GLint) base });
+            for (GLuint v : windows[w])
+            {
+                shortIndices.push_back(v - base);
+            }
+        }
+        indices.rangeCount[l] = indices.ranges.size() - indices.firstRange[l];
+    }
+
+    if (indices.ranges.size() > (size_t) maxRangesPerLevel * mesh.lodCount)
+    {
+        UseLongIndices(mesh, indices);
+        return;
+    }
+    indices.shortIndexData = shortIndices.data();
+    indices.shortIndexCount = shortIndices.size();
+    indices.extraVertexData = extraVertices.data();
+    indices.extraVertexCount = extraVertices.size();
+}
@@ -0,0 +1,15 @@
+#ifndef INDEX_BUFFER_H
+#define INDEX_BUFFER_H
+
+#include <GL/glew.h>
+#include "mesh_cache.h"
+
+/// Splits the levels of mesh into 16-bit ranges, see GpuIndices. Falls back
+/// to UseLongIndices when the levels would need more than maxRangesPerLevel
+/// ranges each on average (every range is a draw call).
+void BuildGpuIndices(const GpuMesh& mesh, GpuIndices& indices, int maxRangesPerLevel = 16);
+
+/// Draws the 32-bit indices of mesh, one range per level
+void UseLongIndices(const GpuMesh& mesh, GpuIndices& indices);
+
+#endif
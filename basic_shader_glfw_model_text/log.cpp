@@ -0,0 +1,155 @@
+#include "log.h"
+
+#include <chrono>
+#include <cstdarg>
+#include <cstdint>
+#include <cstdio>
+#include <thread>
+
+using namespace std;
+
+atomic<int> gLogLevel(LOG_MIN_LEVEL);
+
+namespace
+{
+
+const size_t kLogCapacity = 4096; // messages; a power of two
+const size_t kLogLineSize = 240;
+
+/// One message. sequence tells producers and the consumer whose turn it is
+/// (bounded MPMC queue after Vyukov, with a single consumer).
+struct LogSlot
+{
+    atomic<size_t> sequence;
+    char text[kLogLineSize];
+};
+
+class AsyncLog
+{
+public:
+    AsyncLog()
+    {
+        for (size_t n = 0; n < kLogCapacity; ++n)
+        {
+            slots[n].sequence.store(n, memory_order_relaxed);
+        }
+        writer = thread(&AsyncLog::run, this);
+    }
+
+    ~AsyncLog()
+    {
+        running = false;
+        writer.join();
+    }
+
+    void write(int level, const char* format, va_list args)
+    {
+        size_t pos = tail.load(memory_order_relaxed);
+        LogSlot* slot;
+        for (;;)
+        {
+            slot = &slots[pos & (kLogCapacity - 1)];
+            size_t sequence = slot->sequence.load(memory_order_acquire);
+            if (sequence == pos)
+            {
+                if (tail.compare_exchange_weak(pos, pos + 1, memory_order_relaxed)) break;
+            }
+            else if ((intptr_t) (sequence - pos) < 0)
+            {
+                // the writer hasn't caught up with a whole ring of messages
+                dropped.fetch_add(1, memory_order_relaxed);
+                return;
+            }
+            else
+            {
+                pos = tail.load(memory_order_relaxed);
+            }
+        }
+
+        const char* prefix = level >= LOG_LEVEL_ERROR ? "error: " : level >= LOG_LEVEL_WARN ? "warning: " : "";
+        int length = snprintf(slot->text, kLogLineSize, "%s", prefix);
+        vsnprintf(slot->text + length, kLogLineSize - length, format, args);
+        slot->sequence.store(pos + 1, memory_order_release);
+    }
+
+    void flush()
+    {
+        size_t target = tail.load(memory_order_acquire);
+        while (written.load(memory_order_acquire) < target)
+        {
+            this_thread::sleep_for(chrono::microseconds(200));
+        }
+    }
+
+private:
+    /// Writes whatever is ready and returns how many messages that was
+    size_t drain()
+    {
+        size_t count = 0;
+        for (;;)
+        {
+            LogSlot& slot = slots[head & (kLogCapacity - 1)];
+            if (slot.sequence.load(memory_order_acquire) != head + 1) break;
+
+            fputs(slot.text, stdout);
+            fputc('\n', stdout);
+            slot.sequence.store(head + kLogCapacity, memory_order_release);
+            ++head;
+            ++count;
+        }
+
+        size_t lost = dropped.exchange(0, memory_order_relaxed);
+        if (lost)
+        {
+            fprintf(stdout, "(log: %zu messages dropped)\n", lost);
+        }
+        if (count || lost)
+        {
+            fflush(stdout);
+            written.store(head, memory_order_release);
+        }
+        return count;
+    }
+
+    void run()
+    {
+        while (running)
+        {
+            if (drain() == 0)
+            {
+                this_thread::sleep_for(chrono::milliseconds(2));
+            }
+        }
+        drain();
+    }
+
+    LogSlot slots[kLogCapacity];
+    atomic<size_t> tail{ 0 };    // next slot a producer claims
+    size_t head = 0;             // next slot the writer reads; writer thread only
+    atomic<size_t> written{ 0 }; // head as of the last flush to stdout
+    atomic<size_t> dropped{ 0 };
+    atomic<bool> running{ true };
+    thread writer;
+};
+
+AsyncLog& asyncLog()
+{
+    // started on first use, stopped (after writing everything) at exit
+    static AsyncLog log;
+    return log;
+}
+
+} // namespace
+
+void LogWrite(int level, const char* format, ...)
+{
+    va_list args;
+    va_start(args, format);
+    asyncLog().write(level, format, args);
+    va_end(args);
+}
+
+void LogFlush()
+{
+    asyncLog().flush();
+}
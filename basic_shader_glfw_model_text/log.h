@@ -0,0 +1,42 @@
+#ifndef LOG_H
+#define LOG_H
+
+#include <atomic>
+
+#define LOG_LEVEL_TRACE 0
+#define LOG_LEVEL_DEBUG 1
+#define LOG_LEVEL_INFO  2
+#define LOG_LEVEL_WARN  3
+#define LOG_LEVEL_ERROR 4
+#define LOG_LEVEL_OFF   5
+
+/// Messages below this level are compiled out: their arguments are never
+/// evaluated and no code is generated for them (make LOG_MIN_LEVEL=0 keeps all)
+#ifndef LOG_MIN_LEVEL
+#define LOG_MIN_LEVEL LOG_LEVEL_INFO
+#endif
+
+/// Messages below this level are dropped at run time; only raises LOG_MIN_LEVEL
+extern std::atomic<int> gLogLevel;
+
+/// Formats a message printf-style straight into a slot of a lock-free ring
+/// buffer; a background thread writes the slots to stdout. Never blocks:
+/// when the ring is full the message is dropped and counted.
+void LogWrite(int level, const char* format, ...) __attribute__((format(printf, 2, 3)));
+
+/// Waits until everything logged so far has been written
+void LogFlush();
+
+#define LOG_AT(level, ...) \
+    do { \
+        if ((level) >= LOG_MIN_LEVEL && (level) >= gLogLevel.load(std::memory_order_relaxed)) \
+            LogWrite((level), __VA_ARGS__); \
+    } while (0)
+
+#define LOG_TRACE(...) LOG_AT(LOG_LEVEL_TRACE, __VA_ARGS__)
+#define LOG_DEBUG(...) LOG_AT(LOG_LEVEL_DEBUG, __VA_ARGS__)
+#define LOG_INFO(...)  LOG_AT(LOG_LEVEL_INFO, __VA_ARGS__)
+#define LOG_WARN(...)  LOG_AT(LOG_LEVEL_WARN, __VA_ARGS__)
+#define LOG_ERROR(...) LOG_AT(LOG_LEVEL_ERROR, __VA_ARGS__)
+
+#endif
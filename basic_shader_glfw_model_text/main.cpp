@@ -2,8 +2,10 @@
 #include <cassert>
 #include <cstdlib>
 #include <cstring>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
 #include <string>
-#include <map>
 #include <fstream>
 #include <iostream>
 #include <sstream>
@@ -14,356 +16,299 @@
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
-#include <ft2build.h>
-#include FT_FREETYPE_H
+#include "obj_loader.h"
+#include "mesh_cache.h"
+#include "mesh_optimize.h"
+#include "mesh_simplify.h"
+#include "index_buffer.h"
+#include "gl_state.h"
+#include "render_queue.h"
+#include "transforms.h"
+#include "text.h"
+#include "headless.h"
+#include "simulation.h"
+#include "log.h"
+#include "vertex_format.h"
+#include "material.h"
+#include "shader_program.h"
+#include "shader_watcher.h"
+#include "frame_pacing.h"
+#include "profile.h"
 
 #define BUFFER_OFFSET(i) ((char*)NULL + (i))
 
 using namespace std;
 
 GLuint gProgram[4];
-GLint gIntensityLoc;
+// instanced variants of gProgram[0], [1] and [3]; slot 2 (text) stays unused
+GLuint gInstancedProgram[4];
+// draw the board with one glDrawElementsInstanced per material (I toggles)
+bool gInstancingSupported = false;
+bool gInstanced = true;
+// sort the per-cell draws by program (--no-sort draws in row-major order)
+bool gSortDraws = true;
+// draw every material with one program that reads it from gMaterialBuffer
+// by material ID instead of switching gProgram (--uber-shader, U toggles)
+GLuint gUberProgram, gUberInstancedProgram;
+GLuint gMaterialBuffer;
+bool gUberShaderSupported = false;
+bool gUberShader = false;
 float gIntensity = 1000;
 // according to hw text
 int gWidth = 640, gHeight = 600;
 // grid size
 int rs, cs;
 string filename;
+// OBJ parser threads, 0 = one per core
+int gLoaderThreads = 0;
+// upload the mesh as PackedVertex (--packed-vertices) instead of 6 floats per vertex
+bool gPackedVertices = false;
+// draw cells with the coarsest level of detail that looks the same (--no-lod: always level 0)
+bool gLodEnabled = true;
+// upload 16-bit indices where the mesh allows (--uint-indices: always 32-bit)
+bool gShortIndices = true;
+
+// owns the board; display() draws its latest snapshot
+Simulation gSimulation;
+BoardTransforms gTransforms;
 
-bool flag = true;
-
-// moves && score
-int moves = 0;
-int score = 0;
-
+vector<Vertex> gVertices;
+vector<Texture> gTextures;
+vector<Normal> gNormals;
+vector<Face> gFaces;
 
-struct Obj{
-    int color;
-    double xpos;
-    double ypos;
-    bool selected = false;
-    bool enabled = true;
-    bool matched = false;
-    int match_count = 0;
-    int match_start_index;
-    double msc = 0;
+GLuint gVertexAttribBuffer, gIndexBuffer, gInstanceBuffer;
+GLint gInVertexLoc, gInNormalLoc;
+MeshLod gMeshLods[kMaxLods];
+int gLodCount = 0;
+GpuIndices gIndices; // the ranges of each level in gIndexBuffer; the indices themselves are freed after upload
+// glDrawElementsBaseVertex; without it ranges with a base vertex move the attribute pointers instead
+bool gBaseVertexSupported = false;
+float gMeshDiameter; // of the bounding box, object space
+// a level may be used while its error covers at most this many pixels
+const float kLodErrorPixels = 0.5f;
+
+/// CPU time of the parts of the last display() call, in ms
+struct SectionTimes
+{
+    double drawLoop = 0; // queueing, sorting and submitting the cells
+    double text = 0;
 };
+SectionTimes gSectionTimes;
 
+static double elapsedMs(chrono::steady_clock::time_point from, chrono::steady_clock::time_point to)
+{
+    return chrono::duration<double, milli>(to - from).count();
+}
 
-// grid
-std::vector<std::vector<Obj>> grid;
 
-struct Vertex
-{
-    Vertex(GLfloat inX, GLfloat inY, GLfloat inZ) : x(inX), y(inY), z(inZ) { }
-    GLfloat x, y, z;
+/// Attribute locations of the board programs; each binds the ones it has
+static const vector<pair<string, GLuint>> kBoardAttribs = {
+    { "inVertex", 0 },
+    { "inNormal", 1 },
+    { "modelingMat", 3 }, // instanced programs, takes 3..6
+    { "instanceMaterial", 7 },
 };
 
-struct Texture
-{
-    Texture(GLfloat inU, GLfloat inV) : u(inU), v(inV) { }
-    GLfloat u, v;
-};
+// the box packed positions are decoded against, set by initVBO
+PositionDecode gPositionDecode;
 
-struct Normal
+/// A board program slot and what it is built from. While the window is
+/// open the files are watched, and a changed program replaces the one in
+/// slot as soon as it links.
+struct ReloadableProgram
 {
-    Normal(GLfloat inX, GLfloat inY, GLfloat inZ) : x(inX), y(inY), z(inZ) { }
-    GLfloat x, y, z;
-};
+    ReloadableProgram(GLuint* inSlot, const ProgramSource& inSource) : slot(inSlot), source(inSource) { }
 
-struct Face
-{
-	Face(int v[], int t[], int n[]) {
-		vIndex[0] = v[0];
-		vIndex[1] = v[1];
-		vIndex[2] = v[2];
-		tIndex[0] = t[0];
-		tIndex[1] = t[1];
-		tIndex[2] = t[2];
-		nIndex[0] = n[0];
-		nIndex[1] = n[1];
-		nIndex[2] = n[2];
-	}
-    GLuint vIndex[3], tIndex[3], nIndex[3];
+    GLuint* slot;
+    ProgramSource source;
+    ProgramBuild build; // of the changed files, while build.program is set
 };
+vector<ReloadableProgram> gReloadablePrograms;
+ShaderWatcher gShaderWatcher;
 
-vector<Vertex> gVertices;
-vector<Texture> gTextures;
-vector<Normal> gNormals;
-vector<Face> gFaces;
-
-GLuint gVertexAttribBuffer, gTextVBO, gIndexBuffer;
-GLint gInVertexLoc, gInNormalLoc;
-int gVertexDataSizeInBytes, gNormalDataSizeInBytes;
-
-/// Holds all state information relevant to a character as loaded using FreeType
-struct Character {
-    GLuint TextureID;   // ID handle of the glyph texture
-    glm::ivec2 Size;    // Size of glyph
-    glm::ivec2 Bearing;  // Offset from baseline to left/top of glyph
-    GLuint Advance;    // Horizontal offset to advance to next glyph
-};
+// swap interval, frame rate cap and frame times of the window loop
+FramePacer gFramePacer;
+double gCapFps = 60; // for the M key when --pacing set no cap
+bool gFrameStatsOnExit = false;
 
-std::map<GLchar, Character> Characters;
-
-void colorMatch(){
-
-    for(int i = 0; i < rs; i++){
-        int current_count = 0;
-        for(int j = 0; j < cs-1; j++){
-            if(!grid[i][j].enabled) continue;
-            int current_color = grid[i][j].color;
-            int start_index;
-            std::cout<<"Current color for "<<i<<" "<<j<<" is "<<current_color<<std::endl;
-            if(grid[i][j+1].color == current_color){
-                current_count++;
-                std::cout<<i<<" row's "<<j<<" and "<<j+1<<" same color current_count: "<<current_count<<std::endl;
-                if(current_count == 2){
-                    std::cout<<"Started to select from "<<i<<" "<<j<<std::endl;
-                    grid[i][j].matched = true;
-                    grid[i][j-1].matched = true;
-                    grid[i][j+1].matched = true;
-
-                    grid[i][j].match_count = current_count;
-                    grid[i][j-1].match_count = current_count;
-                    grid[i][j+1].match_count = current_count;
-                    
-                    start_index = j-1;
-
-                    grid[i][j].match_start_index = start_index;
-                    grid[i][j-1].match_start_index = start_index;
-                    grid[i][j+1].match_start_index = start_index;
-
-                }
-                else if(current_count > 3){
-                    grid[i][j].matched = true;
-                    grid[i][j].match_start_index= start_index;
-                    grid[i][start_index].match_count++;
-                }
-            }else{
-                current_count = 0;
-        
-            }
-        }
+/// BuildProgram for the programs the board cannot do without
+static GLuint requireProgram(const ProgramSource& source)
+{
+    GLuint program = BuildProgram(source);
+    if (!program)
+    {
+        cout << "Cannot build the program of " << source.vertexFile << " and " << source.fragmentFile << endl;
+        exit(-1);
     }
+    // look uniform locations up once instead of every frame
+    RegisterProgram(program);
+    return program;
 }
 
-bool ParseObj(const string& fileName)
+/// Sets the uniforms of a board program that don't change every frame
+static void setProgramConstants(GLuint program)
 {
-    fstream myfile;
-
-    // Open the input 
-    myfile.open(fileName.c_str(), std::ios::in);
-
-    if (myfile.is_open())
+    const ProgramUniforms& u = Uniforms(program);
+    UseProgram(program);
+    glUniform1f(u.intensity, gIntensity);
+    if (gPackedVertices)
     {
-        string curLine;
-
-        while (getline(myfile, curLine))
+        // every board program decodes against the same box
+        glUniform3fv(u.positionOffset, 1, gPositionDecode.offset);
+        glUniform3fv(u.positionScale, 1, gPositionDecode.scale);
+    }
+    if (gUberShaderSupported)
+    {
+        GLuint block = glGetUniformBlockIndex(program, "Materials");
+        if (block != GL_INVALID_INDEX)
         {
-            stringstream str(curLine);
-            GLfloat c1, c2, c3;
-            GLuint index[9];
-            string tmp;
-
-            if (curLine.length() >= 2)
-            {
-                if (curLine[0] == '#') // comment
-                {
-                    continue;
-                }
-                else if (curLine[0] == 'v')
-                {
-                    if (curLine[1] == 't') // texture
-                    {
-                        str >> tmp; // consume "vt"
-                        str >> c1 >> c2;
-                        gTextures.push_back(Texture(c1, c2));
-                    }
-                    else if (curLine[1] == 'n') // normal
-                    {
-                        str >> tmp; // consume "vn"
-                        str >> c1 >> c2 >> c3;
-                        gNormals.push_back(Normal(c1, c2, c3));
-                    }
-                    else // vertex
-                    {
-                        str >> tmp; // consume "v"
-                        str >> c1 >> c2 >> c3;
-                        gVertices.push_back(Vertex(c1, c2, c3));
-                    }
-                }
-                else if (curLine[0] == 'f') // face
-                {
-                    str >> tmp; // consume "f"
-					char c;
-					int vIndex[3],  nIndex[3], tIndex[3];
-					str >> vIndex[0]; str >> c >> c; // consume "//"
-					str >> nIndex[0]; 
-					str >> vIndex[1]; str >> c >> c; // consume "//"
-					str >> nIndex[1]; 
-					str >> vIndex[2]; str >> c >> c; // consume "//"
-					str >> nIndex[2]; 
-
-					assert(vIndex[0] == nIndex[0] &&
-						   vIndex[1] == nIndex[1] &&
-						   vIndex[2] == nIndex[2]); // a limitation for now
-
-					// make indices start from 0
-					for (int c = 0; c < 3; ++c)
-					{
-						vIndex[c] -= 1;
-						nIndex[c] -= 1;
-						tIndex[c] -= 1;
-					}
-
-                    gFaces.push_back(Face(vIndex, tIndex, nIndex));
-                }
-                else
-                {
-                    cout << "Ignoring unidentified line in obj file: " << curLine << endl;
-                }
-            }
-
-            //data += curLine;
-            if (!myfile.eof())
-            {
-                //data += "\n";
-            }
+            glUniformBlockBinding(program, block, 0);
         }
-
-        myfile.close();
     }
-    else
+}
+
+/// Builds vs and frag_uber.glsl with the material block into slot; returns
+/// false when that fails, as it will where GLSL lacks uniform blocks
+static bool createUberProgram(GLuint& slot, const char* vs, const string& defines)
+{
+    ProgramSource source = { vs, "frag_uber.glsl", defines + "#define UBER_VERTEX_SHADER\n",
+                             { "material.glsl", "vertex_format.glsl" }, { "material.glsl" }, kBoardAttribs };
+    slot = BuildProgram(source);
+    if (!slot)
     {
+        printf("Uber shader %s is not available\n", vs);
         return false;
     }
-
-	assert(gVertices.size() == gNormals.size());
-
+    RegisterProgram(slot);
+    gReloadablePrograms.emplace_back(&slot, source);
     return true;
 }
 
-bool ReadDataFromFile(
-    const string& fileName, ///< [in]  Name of the shader file
-    string&       data)     ///< [out] The contents of the file
+/// Builds gUberProgram (and gUberInstancedProgram with instancing) and
+/// uploads kBoardMaterials to binding point 0 for them
+static void initUberShader(const string& defines)
 {
-    fstream myfile;
-
-    // Open the input 
-    myfile.open(fileName.c_str(), std::ios::in);
-
-    if (myfile.is_open())
+    gUberShaderSupported = GLEW_ARB_uniform_buffer_object;
+    if (gUberShaderSupported)
     {
-        string curLine;
-
-        while (getline(myfile, curLine))
-        {
-            data += curLine;
-            if (!myfile.eof())
-            {
-                data += "\n";
-            }
-        }
-
-        myfile.close();
+        gUberShaderSupported = createUberProgram(gUberProgram, "vert_uber.glsl", defines) &&
+                               (!gInstancingSupported || createUberProgram(gUberInstancedProgram, "vert_uber.glsl", defines + "#define INSTANCED\n"));
     }
-    else
+    if (gUberShaderSupported)
     {
-        return false;
+        glGenBuffers(1, &gMaterialBuffer);
+        glBindBuffer(GL_UNIFORM_BUFFER, gMaterialBuffer);
+        glBufferData(GL_UNIFORM_BUFFER, sizeof(kBoardMaterials), kBoardMaterials, GL_STATIC_DRAW);
+        glBindBufferBase(GL_UNIFORM_BUFFER, 0, gMaterialBuffer);
     }
-
-    return true;
+    gUberShader = gUberShader && gUberShaderSupported;
 }
 
-void createVS(GLuint& program, const string& filename)
+void initShaders()
 {
-    string shaderSource;
+    PROFILE_SCOPE("initShaders");
+    // the board shaders read the mesh through decodePosition()/decodeNormal()
+    string defines = gPackedVertices ? "#define PACKED_VERTICES\n" : "";
 
-    if (!ReadDataFromFile(filename, shaderSource))
+    const char* boardVS[4] = { "vert0.glsl", "vert1.glsl", NULL, "vert2.glsl" };
+    const char* boardFS[4] = { "frag0.glsl", "frag1.glsl", NULL, "frag2.glsl" };
+    for (int i = 0; i < 4; ++i)
     {
-        cout << "Cannot find file name: " + filename << endl;
-        exit(-1);
-    }
-
-    GLint length = shaderSource.length();
-    const GLchar* shader = (const GLchar*) shaderSource.c_str();
+        if (!boardVS[i]) continue;
 
-    GLuint vs = glCreateShader(GL_VERTEX_SHADER);
-    glShaderSource(vs, 1, &shader, &length);
-    glCompileShader(vs);
+        ProgramSource source = { boardVS[i], boardFS[i], defines, { "vertex_format.glsl" }, {}, kBoardAttribs };
+        gProgram[i] = requireProgram(source);
+        gReloadablePrograms.emplace_back(&gProgram[i], source);
+    }
+    // initFonts keeps the text program, so it is not reloaded
+    gProgram[2] = requireProgram({ "vert_text.glsl", "frag_text.glsl", "", {}, {}, { { "vertex", 2 } } });
+
+    // the same shaders built with INSTANCED take the per-cell transforms
+    // from an instance buffer; needs glVertexAttribDivisor and
+    // glDrawElementsInstanced
+    gInstancingSupported = GLEW_VERSION_3_3;
+    if (gInstancingSupported)
+    {
+        for (int i = 0; i < 4; ++i)
+        {
+            if (!boardVS[i]) continue;
 
-    char output[1024] = {0};
-    glGetShaderInfoLog(vs, 1024, &length, output);
-    printf("VS compile log: %s\n", output);
+            ProgramSource source = { boardVS[i], boardFS[i], defines + "#define INSTANCED\n", { "vertex_format.glsl" }, {}, kBoardAttribs };
+            gInstancedProgram[i] = requireProgram(source);
+            gReloadablePrograms.emplace_back(&gInstancedProgram[i], source);
+        }
+    }
+    gInstanced = gInstanced && gInstancingSupported;
 
-    glAttachShader(program, vs);
+    initUberShader(defines);
+    printf("Programs: %d from the binary cache, %d compiled (%d cache entries rejected) in %.1f ms\n",
+           gProgramBuildStats.fromCache, gProgramBuildStats.compiled, gProgramBuildStats.cacheRejected,
+           gProgramBuildStats.ms);
 }
 
-void createFS(GLuint& program, const string& filename)
+/// Render thread, once a frame: starts building the programs whose files
+/// changed and swaps in those that are done. Where the driver compiles in
+/// parallel this never waits for it; elsewhere the compile happens here.
+void pollShaderReloads()
 {
-    string shaderSource;
-
-    if (!ReadDataFromFile(filename, shaderSource))
+    PROFILE_SCOPE("pollShaderReloads");
+    int id;
+    ProgramText text;
+    while (gShaderWatcher.takeChanged(id, text))
     {
-        cout << "Cannot find file name: " + filename << endl;
-        exit(-1);
+        ReloadableProgram& reloadable = gReloadablePrograms[id];
+        if (reloadable.build.program)
+        {
+            CancelProgramBuild(reloadable.build); // the files changed again
+        }
+        BeginProgramBuild(reloadable.source, text, reloadable.build);
     }
 
-    GLint length = shaderSource.length();
-    const GLchar* shader = (const GLchar*) shaderSource.c_str();
-
-    GLuint fs = glCreateShader(GL_FRAGMENT_SHADER);
-    glShaderSource(fs, 1, &shader, &length);
-    glCompileShader(fs);
+    for (ReloadableProgram& reloadable : gReloadablePrograms)
+    {
+        if (!reloadable.build.program || !IsProgramBuildDone(reloadable.build)) continue;
 
-    char output[1024] = {0};
-    glGetShaderInfoLog(fs, 1024, &length, output);
-    printf("FS compile log: %s\n", output);
+        const ProgramSource& source = reloadable.source;
+        GLuint program = FinishProgramBuild(source, reloadable.build);
+        if (!program)
+        {
+            printf("Keeping the last working program of %s and %s\n", source.vertexFile.c_str(), source.fragmentFile.c_str());
+            continue;
+        }
 
-    glAttachShader(program, fs);
+        glDeleteProgram(*reloadable.slot);
+        *reloadable.slot = program;
+        RegisterProgram(program);
+        InvalidateGLState(); // the old name may be handed out again
+        setProgramConstants(program);
+        // both variants of a board program read the same files
+        bool instanced = source.vertexDefines.find("#define INSTANCED\n") != string::npos;
+        printf("Reloaded %s and %s%s\n", source.vertexFile.c_str(), source.fragmentFile.c_str(), instanced ? " (instanced)" : "");
+    }
 }
 
-void initShaders()
+/// Points attributes 0 and 1 at the mesh, starting from vertex baseVertex;
+/// gVertexAttribBuffer has to be bound
+void setMeshAttribPointers(GLint baseVertex = 0)
 {
-    gProgram[0] = glCreateProgram();
-    gProgram[1] = glCreateProgram();
-    gProgram[2] = glCreateProgram();
-    gProgram[3] = glCreateProgram();
-
-    createVS(gProgram[0], "vert0.glsl");
-    createFS(gProgram[0], "frag0.glsl");
-
-    createVS(gProgram[1], "vert1.glsl");
-    createFS(gProgram[1], "frag1.glsl");
-
-    createVS(gProgram[3], "vert2.glsl");
-    createFS(gProgram[3], "frag2.glsl");
-
-    createVS(gProgram[2], "vert_text.glsl");
-    createFS(gProgram[2], "frag_text.glsl");
-
-    glBindAttribLocation(gProgram[0], 0, "inVertex");
-    glBindAttribLocation(gProgram[0], 1, "inNormal");
-    glBindAttribLocation(gProgram[1], 0, "inVertex");
-    glBindAttribLocation(gProgram[1], 1, "inNormal");
-    glBindAttribLocation(gProgram[3], 0, "inVertex");
-    glBindAttribLocation(gProgram[3], 1, "inNormal");
-    glBindAttribLocation(gProgram[2], 2, "vertex");
-
-    glLinkProgram(gProgram[0]);
-    glLinkProgram(gProgram[1]);
-    glLinkProgram(gProgram[2]);
-    glLinkProgram(gProgram[3]);
-    glUseProgram(gProgram[0]);
-
-    gIntensityLoc = glGetUniformLocation(gProgram[0], "intensity");
-    cout << "gIntensityLoc = " << gIntensityLoc << endl;
-    glUniform1f(gIntensityLoc, gIntensity);
+    if (gPackedVertices)
+    {
+        size_t base = baseVertex * sizeof(PackedVertex);
+        SetVertexAttribPointer(0, 3, GL_UNSIGNED_SHORT, GL_TRUE, sizeof(PackedVertex), BUFFER_OFFSET(base));
+        SetVertexAttribPointer(1, 2, GL_SHORT, GL_TRUE, sizeof(PackedVertex), BUFFER_OFFSET(base + kPackedNormalOffset));
+    }
+    else
+    {
+        size_t base = baseVertex * 6 * sizeof(GLfloat);
+        SetVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(GLfloat), BUFFER_OFFSET(base));
+        SetVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(GLfloat), BUFFER_OFFSET(base + 3 * sizeof(GLfloat)));
+    }
 }
 
-void initVBO()
+void initVBO(const GpuMesh& mesh)
 {
+    PROFILE_SCOPE("initVBO");
     glEnableVertexAttribArray(0);
     glEnableVertexAttribArray(1);
     assert(glGetError() == GL_NONE);
@@ -373,361 +318,411 @@ void initVBO()
 
     assert(gVertexAttribBuffer > 0 && gIndexBuffer > 0);
 
-    glBindBuffer(GL_ARRAY_BUFFER, gVertexAttribBuffer);
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, gIndexBuffer);
-
-    gVertexDataSizeInBytes = gVertices.size() * 3 * sizeof(GLfloat);
-    gNormalDataSizeInBytes = gNormals.size() * 3 * sizeof(GLfloat);
-    int indexDataSizeInBytes = gFaces.size() * 3 * sizeof(GLuint);
-    GLfloat* vertexData = new GLfloat [gVertices.size() * 3];
-    GLfloat* normalData = new GLfloat [gNormals.size() * 3];
-    GLuint* indexData = new GLuint [gFaces.size() * 3];
-
-    float minX = 1e6, maxX = -1e6;
-    float minY = 1e6, maxY = -1e6;
-    float minZ = 1e6, maxZ = -1e6;
-
-    for (int i = 0; i < gVertices.size(); ++i)
+    if (gInstancingSupported)
     {
-        vertexData[3*i] = gVertices[i].x;
-        vertexData[3*i+1] = gVertices[i].y;
-        vertexData[3*i+2] = gVertices[i].z;
-
-        minX = std::min(minX, gVertices[i].x);
-        maxX = std::max(maxX, gVertices[i].x);
-        minY = std::min(minY, gVertices[i].y);
-        maxY = std::max(maxY, gVertices[i].y);
-        minZ = std::min(minZ, gVertices[i].z);
-        maxZ = std::max(maxZ, gVertices[i].z);
+        glGenBuffers(1, &gInstanceBuffer);
     }
 
-    std::cout << "minX = " << minX << std::endl;
-    std::cout << "maxX = " << maxX << std::endl;
-    std::cout << "minY = " << minY << std::endl;
-    std::cout << "maxY = " << maxY << std::endl;
-    std::cout << "minZ = " << minZ << std::endl;
-    std::cout << "maxZ = " << maxZ << std::endl;
-
-    for (int i = 0; i < gNormals.size(); ++i)
+    // setMeshAttribPointers goes through the state tracker
+    InvalidateGLState();
+    BindBuffer(GL_ARRAY_BUFFER, gVertexAttribBuffer);
+    BindBuffer(GL_ELEMENT_ARRAY_BUFFER, gIndexBuffer);
+
+    std::cout << "minX = " << mesh.bboxMin[0] << std::endl;
+    std::cout << "maxX = " << mesh.bboxMax[0] << std::endl;
+    std::cout << "minY = " << mesh.bboxMin[1] << std::endl;
+    std::cout << "maxY = " << mesh.bboxMax[1] << std::endl;
+    std::cout << "minZ = " << mesh.bboxMin[2] << std::endl;
+    std::cout << "maxZ = " << mesh.bboxMax[2] << std::endl;
+
+    // gIndices comes from init() with the mesh; the 16-bit form may add
+    // copies of a few vertices, see GpuIndices
+    if (!gShortIndices && gIndices.type == GL_UNSIGNED_SHORT)
     {
-        normalData[3*i] = gNormals[i].x;
-        normalData[3*i+1] = gNormals[i].y;
-        normalData[3*i+2] = gNormals[i].z;
+        UseLongIndices(mesh, gIndices);
     }
+    const GLuint* extraVertices = gIndices.extraVertexData;
+    GLsizei extraVertexCount = gIndices.extraVertexCount;
 
-    for (int i = 0; i < gFaces.size(); ++i)
+    if (gPackedVertices)
     {
-        indexData[3*i] = gFaces[i].vIndex[0];
-        indexData[3*i+1] = gFaces[i].vIndex[1];
-        indexData[3*i+2] = gFaces[i].vIndex[2];
-    }
+        vector<PackedVertex> packed;
+        PackVertices(mesh, packed, gPositionDecode);
+        PackingError error = MeasurePackingError(mesh, packed, gPositionDecode);
 
+        packed.reserve(packed.size() + extraVertexCount);
+        for (GLsizei e = 0; e < extraVertexCount; ++e)
+        {
+            packed.push_back(packed[extraVertices[e]]);
+        }
+        glBufferData(GL_ARRAY_BUFFER, packed.size() * sizeof(PackedVertex), packed.data(), GL_STATIC_DRAW);
 
-    glBufferData(GL_ARRAY_BUFFER, gVertexDataSizeInBytes + gNormalDataSizeInBytes, 0, GL_STATIC_DRAW);
-    glBufferSubData(GL_ARRAY_BUFFER, 0, gVertexDataSizeInBytes, vertexData);
-    glBufferSubData(GL_ARRAY_BUFFER, gVertexDataSizeInBytes, gNormalDataSizeInBytes, normalData);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, indexDataSizeInBytes, indexData, GL_STATIC_DRAW);
-
-    // done copying; can free now
-    delete[] vertexData;
-    delete[] normalData;
-    delete[] indexData;
+        printf("Packed vertices: %zu instead of %zu bytes each\n", sizeof(PackedVertex), 6 * sizeof(GLfloat));
+        printf("  position error max %g mean %g (max %.5f%% of the bbox diagonal)\n",
+               error.maxPosition, error.meanPosition, 100 * error.maxPosition / error.bboxDiagonal);
+        printf("  normal error max %.4f mean %.4f degrees\n", error.maxNormalDegrees, error.meanNormalDegrees);
+    }
+    else if (extraVertexCount == 0)
+    {
+        // the mesh is already interleaved, so this is a straight copy from the
+        // parsed arrays or the mapped cache file
+        glBufferData(GL_ARRAY_BUFFER, mesh.vertexDataSizeInBytes(), mesh.vertexData, GL_STATIC_DRAW);
+    }
+    else
+    {
+        vector<GLfloat> extra;
+        extra.reserve(extraVertexCount * 6);
+        for (GLsizei e = 0; e < extraVertexCount; ++e)
+        {
+            const GLfloat* v = mesh.vertexData + 6 * extraVertices[e];
+            extra.insert(extra.end(), v, v + 6);
+        }
+        glBufferData(GL_ARRAY_BUFFER, mesh.vertexDataSizeInBytes() + extra.size() * sizeof(GLfloat), NULL, GL_STATIC_DRAW);
+        glBufferSubData(GL_ARRAY_BUFFER, 0, mesh.vertexDataSizeInBytes(), mesh.vertexData);
+        glBufferSubData(GL_ARRAY_BUFFER, mesh.vertexDataSizeInBytes(), extra.size() * sizeof(GLfloat), extra.data());
+    }
 
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, 0);
-    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 0, BUFFER_OFFSET(gVertexDataSizeInBytes));
+    if (gIndices.type == GL_UNSIGNED_SHORT)
+    {
+        size_t shortBytes = (size_t) gIndices.shortIndexCount * sizeof(GLushort);
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, shortBytes, gIndices.shortIndexData, GL_STATIC_DRAW);
+        printf("Indices: 16-bit in %zu ranges, %zu KB instead of %zu KB (%d vertices copied)\n", gIndices.ranges.size(),
+               shortBytes / 1024, (size_t) mesh.indexDataSizeInBytes() / 1024, extraVertexCount);
+    }
+    else
+    {
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, mesh.indexDataSizeInBytes(), mesh.indexData, GL_STATIC_DRAW);
+        printf("Indices: 32-bit, %zu KB\n", (size_t) mesh.indexDataSizeInBytes() / 1024);
+    }
+    // the arrays may point into the mapped file of mesh, which goes with it
+    gIndices.shortIndexData = nullptr;
+    gIndices.shortIndexCount = 0;
+    gIndices.extraVertexData = nullptr;
+    gIndices.extraVertexCount = 0;
+    vector<GLushort>().swap(gIndices.shortIndexStorage);
+    vector<GLuint>().swap(gIndices.extraVertexStorage);
+    gBaseVertexSupported = GLEW_VERSION_3_2 || GLEW_ARB_draw_elements_base_vertex;
+    gLodCount = mesh.lodCount;
+    copy(mesh.lods, mesh.lods + mesh.lodCount, gMeshLods);
+    gMeshDiameter = 0;
+    for (int k = 0; k < 3; ++k)
+    {
+        float extent = mesh.bboxMax[k] - mesh.bboxMin[k];
+        gMeshDiameter += extent * extent;
+    }
+    gMeshDiameter = sqrt(gMeshDiameter);
 
+    setMeshAttribPointers();
 }
 
-void initFonts(int windowWidth, int windowHeight)
+void init() 
 {
-    // Set OpenGL options
-    //glEnable(GL_CULL_FACE);
-    glEnable(GL_BLEND);
-    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
-
-    glm::mat4 projection = glm::ortho(0.0f, static_cast<GLfloat>(windowWidth), 0.0f, static_cast<GLfloat>(windowHeight));
-    glUseProgram(gProgram[2]);
-    glUniformMatrix4fv(glGetUniformLocation(gProgram[2], "projection"), 1, GL_FALSE, glm::value_ptr(projection));
+    PROFILE_SCOPE("init");
+    auto start = chrono::steady_clock::now();
 
-    // FreeType
-    FT_Library ft;
-    // All functions return a value different than 0 whenever an error occurred
-    if (FT_Init_FreeType(&ft))
+    // a warm start maps the cached GPU layout and skips the OBJ entirely
+    GpuMesh mesh;
+    bool cached = LoadMeshCache(filename, mesh, gIndices);
+    if (!cached)
     {
-        std::cout << "ERROR::FREETYPE: Could not init FreeType Library" << std::endl;
+        //ParseObj("armadillo.obj");
+        ParseObj(filename, gLoaderThreads);
+        BuildGpuMesh(mesh);
+        // the mesh is drawn once per cell, so it pays to do this once and cache the result
+        MeshOptimizeStats stats = OptimizeGpuMesh(mesh);
+        printf("Mesh optimized in %.1f ms: ACMR %.3f -> %.3f (%d-entry FIFO), %d clusters\n",
+               stats.ms, stats.acmrBefore, stats.acmrAfter, kVertexCacheSize, stats.clusters);
+        double lodMs = BuildLodChain(mesh);
+        printf("Levels of detail built in %.1f ms:", lodMs);
+        for (int l = 0; l < mesh.lodCount; ++l)
+        {
+            printf(" %u triangles (error %g)", mesh.lods[l].indexCount / 3, mesh.lods[l].error);
+        }
+        printf("\n");
+        // cached in the 16-bit form even with --uint-indices, which initVBO applies
+        BuildGpuIndices(mesh, gIndices);
+        SaveMeshCache(filename, mesh, gIndices);
     }
 
-    // Load font as face
-    FT_Face face;
-    if (FT_New_Face(ft, "/usr/share/fonts/truetype/liberation/LiberationSerif-Italic.ttf", 0, &face))
+    glEnable(GL_DEPTH_TEST);
+    initShaders();
+    initFonts(gProgram[2], gWidth, gHeight);
+    initVBO(mesh);
+    InvalidateGLState(); // the init functions bind with raw GL calls
+    for (const ReloadableProgram& reloadable : gReloadablePrograms)
     {
-        std::cout << "ERROR::FREETYPE: Failed to load font" << std::endl;
+        setProgramConstants(*reloadable.slot);
     }
 
-    // Set size to load glyphs as
-    FT_Set_Pixel_Sizes(face, 0, 48);
+    cout << "Mesh " << (cached ? "loaded from cache" : "built from OBJ") << ", ready in "
+         << chrono::duration<double, milli>(chrono::steady_clock::now() - start).count() << " ms" << endl;
+}
 
-    // Disable byte-alignment restriction
-    glPixelStorei(GL_UNPACK_ALIGNMENT, 1); 
+/// Coarsest level of detail whose error stays below kLodErrorPixels when
+/// one object space unit covers pixelsPerUnit pixels
+int selectLod(float pixelsPerUnit)
+{
+    int lod = gLodEnabled ? gLodCount - 1 : 0;
+    while (lod > 0 && gMeshLods[lod].error * pixelsPerUnit > kLodErrorPixels)
+    {
+        --lod;
+    }
+    return lod;
+}
 
-    // Load first 128 characters of ASCII set
-    for (GLubyte c = 0; c < 128; c++)
+/// One draw call per index range of level lod; instanceCount 0 draws without instancing
+void drawLod(int lod, GLsizei instanceCount)
+{
+    int first = gIndices.firstRange[lod];
+    for (int r = first; r < first + gIndices.rangeCount[lod]; ++r)
     {
-        // Load character glyph 
-        if (FT_Load_Char(face, c, FT_LOAD_RENDER))
+        const IndexRange& range = gIndices.ranges[r];
+        const void* offset = BUFFER_OFFSET(range.firstIndex * gIndices.indexSize());
+        if (instanceCount > 0)
         {
-            std::cout << "ERROR::FREETYTPE: Failed to load Glyph" << std::endl;
+            // instancing needs GL 3.3, which has base vertices
+            glDrawElementsInstancedBaseVertex(GL_TRIANGLES, range.indexCount, gIndices.type, offset, instanceCount, range.baseVertex);
+            CountDrawCall((long) instanceCount * (range.indexCount / 3));
             continue;
         }
-        // Generate texture
-        GLuint texture;
-        glGenTextures(1, &texture);
-        glBindTexture(GL_TEXTURE_2D, texture);
-        glTexImage2D(
-                GL_TEXTURE_2D,
-                0,
-                GL_RED,
-                face->glyph->bitmap.width,
-                face->glyph->bitmap.rows,
-                0,
-                GL_RED,
-                GL_UNSIGNED_BYTE,
-                face->glyph->bitmap.buffer
-                );
-        // Set texture options
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-        // Now store character for later use
-        Character character = {
-            texture,
-            glm::ivec2(face->glyph->bitmap.width, face->glyph->bitmap.rows),
-            glm::ivec2(face->glyph->bitmap_left, face->glyph->bitmap_top),
-            face->glyph->advance.x
-        };
-        Characters.insert(std::pair<GLchar, Character>(c, character));
-    }
-
-    glBindTexture(GL_TEXTURE_2D, 0);
-    // Destroy FreeType once we're finished
-    FT_Done_Face(face);
-    FT_Done_FreeType(ft);
-
-    //
-    // Configure VBO for texture quads
-    //
-    glGenBuffers(1, &gTextVBO);
-    glBindBuffer(GL_ARRAY_BUFFER, gTextVBO);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(GLfloat) * 6 * 4, NULL, GL_DYNAMIC_DRAW);
-
-    glEnableVertexAttribArray(2);
-    glVertexAttribPointer(2, 4, GL_FLOAT, GL_FALSE, 4 * sizeof(GLfloat), 0);
-
-    glBindBuffer(GL_ARRAY_BUFFER, 0);
-}
 
-void init() 
-{
-	//ParseObj("armadillo.obj");
-	ParseObj(filename);
-
-    glEnable(GL_DEPTH_TEST);
-    initShaders();
-    initFonts(gWidth, gHeight);
-    initVBO();
+        if (range.baseVertex == 0 || !gBaseVertexSupported)
+        {
+            setMeshAttribPointers(range.baseVertex);
+            glDrawElements(GL_TRIANGLES, range.indexCount, gIndices.type, offset);
+        }
+        else
+        {
+            glDrawElementsBaseVertex(GL_TRIANGLES, range.indexCount, gIndices.type, (void*) offset, range.baseVertex);
+        }
+        CountDrawCall(range.indexCount / 3);
+    }
 }
 
-void drawModel()
+void drawModel(int lod)
 {
-	glBindBuffer(GL_ARRAY_BUFFER, gVertexAttribBuffer);
-	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, gIndexBuffer);
+	// consecutive cells share all of this, so these are usually no-ops
+	BindBuffer(GL_ARRAY_BUFFER, gVertexAttribBuffer);
+	BindBuffer(GL_ELEMENT_ARRAY_BUFFER, gIndexBuffer);
 
-	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, 0);
-	glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 0, BUFFER_OFFSET(gVertexDataSizeInBytes));
+	setMeshAttribPointers();
 
-	glDrawElements(GL_TRIANGLES, gFaces.size() * 3, GL_UNSIGNED_INT, 0);
+	drawLod(lod, 0);
 }
 
-void renderText(const std::string& text, GLfloat x, GLfloat y, GLfloat scale, glm::vec3 color)
+/// Draws the queue one cell at a time; the queue is expected to be sorted
+/// so that consecutive draws share a program. The uber shader draws every
+/// cell with one program and a materialId uniform.
+void drawQueue(const RenderQueue& queue, const glm::mat4& orthoMat)
 {
-    // Activate corresponding render state	
-    glUseProgram(gProgram[2]);
-    glUniform3f(glGetUniformLocation(gProgram[2], "textColor"), color.x, color.y, color.z);
-    glActiveTexture(GL_TEXTURE0);
-
-    // Iterate through all characters
-    std::string::const_iterator c;
-    for (c = text.begin(); c != text.end(); c++) 
+    PROFILE_GPU_SCOPE("drawQueue");
+    for (size_t begin = 0; begin < queue.order.size(); )
     {
-        Character ch = Characters[*c];
+        size_t count = queue.runLength(begin);
+        GLuint program = gUberShader ? gUberProgram : gProgram[queue.order[begin].material()];
+        const ProgramUniforms& u = Uniforms(program);
 
-        GLfloat xpos = x + ch.Bearing.x * scale;
-        GLfloat ypos = y - (ch.Size.y - ch.Bearing.y) * scale;
+        UseProgram(program);
+        glUniformMatrix4fv(u.orthoMat, 1, GL_FALSE, glm::value_ptr(orthoMat));
 
-        GLfloat w = ch.Size.x * scale;
-        GLfloat h = ch.Size.y * scale;
+        // one scope per run; per cell, big boards would fill the ring in a few frames
+        PROFILE_SCOPE("drawQueue cells");
+        for (size_t n = begin; n < begin + count; ++n)
+        {
+            const glm::mat4& modelMat = queue.matrices[queue.order[n].index];
+            glm::mat4 modelMatInv = NormalMatrix(modelMat);
 
-        // Update VBO for each character
-        GLfloat vertices[6][4] = {
-            { xpos,     ypos + h,   0.0, 0.0 },            
-            { xpos,     ypos,       0.0, 1.0 },
-            { xpos + w, ypos,       1.0, 1.0 },
+            glUniformMatrix4fv(u.modelingMat, 1, GL_FALSE, glm::value_ptr(modelMat));
+            glUniformMatrix4fv(u.modelingMatInvTr, 1, GL_FALSE, glm::value_ptr(modelMatInv));
+            if (gUberShader)
+            {
+                glUniform1i(u.materialId, queue.materials[queue.order[n].index]);
+            }
 
-            { xpos,     ypos + h,   0.0, 0.0 },
-            { xpos + w, ypos,       1.0, 1.0 },
-            { xpos + w, ypos + h,   1.0, 0.0 }           
-        };
+            drawModel(queue.order[n].lod());
+        }
+        begin += count;
+    }
+}
 
-        // Render glyph texture over quad
-        glBindTexture(GL_TEXTURE_2D, ch.TextureID);
+/// Fills gInstanceBuffer with the matrices of the queue in draw order,
+/// followed by the material IDs for the uber shader; returns the size of
+/// the matrices
+static size_t uploadInstances(const RenderQueue& queue)
+{
+    PROFILE_SCOPE("uploadInstances");
+    // instance data has to be contiguous per run, so gather it in draw order
+    static vector<glm::mat4> instances;
+    static vector<GLubyte> instanceMaterials;
+    instances.resize(queue.order.size());
+    instanceMaterials.resize(queue.order.size());
+    for (size_t n = 0; n < queue.order.size(); ++n)
+    {
+        instances[n] = queue.matrices[queue.order[n].index];
+        instanceMaterials[n] = queue.materials[queue.order[n].index];
+    }
 
-        // Update content of VBO memory
-        glBindBuffer(GL_ARRAY_BUFFER, gTextVBO);
-        glBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(vertices), vertices); // Be sure to use glBufferSubData and not glBufferData
+    // orphan last frame's storage
+    size_t matrixBytes = instances.size() * sizeof(glm::mat4);
+    BindBuffer(GL_ARRAY_BUFFER, gInstanceBuffer);
+    if (gUberShader)
+    {
+        glBufferData(GL_ARRAY_BUFFER, matrixBytes + instanceMaterials.size(), NULL, GL_STREAM_DRAW);
+        glBufferSubData(GL_ARRAY_BUFFER, 0, matrixBytes, instances.data());
+        glBufferSubData(GL_ARRAY_BUFFER, matrixBytes, instanceMaterials.size(), instanceMaterials.data());
+    }
+    else
+    {
+        glBufferData(GL_ARRAY_BUFFER, matrixBytes, instances.data(), GL_STREAM_DRAW);
+    }
+    return matrixBytes;
+}
 
-        //glBindBuffer(GL_ARRAY_BUFFER, 0);
+/// Draws each material's run of the sorted queue with gInstancedProgram[k]
+/// in one instanced draw call per level of detail and index range. The
+/// uber shader draws all materials of a level together, taking the
+/// material ID of each instance from after the matrices.
+void drawModelInstanced(const RenderQueue& queue, const glm::mat4& orthoMat)
+{
+    PROFILE_GPU_SCOPE("drawModelInstanced");
+    if (queue.order.empty())
+    {
+        return;
+    }
+
+    size_t matrixBytes = uploadInstances(queue);
+    if (gUberShader)
+    {
+        glEnableVertexAttribArray(7);
+        glVertexAttribDivisor(7, 1);
+    }
 
-        // Render quad
-        glDrawArrays(GL_TRIANGLES, 0, 6);
-        // Now advance cursors for next glyph (note that advance is number of 1/64 pixels)
+    BindBuffer(GL_ARRAY_BUFFER, gVertexAttribBuffer);
+    BindBuffer(GL_ELEMENT_ARRAY_BUFFER, gIndexBuffer);
+    setMeshAttribPointers();
 
-        x += (ch.Advance >> 6) * scale; // Bitshift by 6 to get value in pixels (2^6 = 64 (divide amount of 1/64th pixels by 64 to get amount of pixels))
+    BindBuffer(GL_ARRAY_BUFFER, gInstanceBuffer);
+    for (int c = 0; c < 4; ++c)
+    {
+        glEnableVertexAttribArray(3 + c);
+        glVertexAttribDivisor(3 + c, 1);
     }
 
-    glBindTexture(GL_TEXTURE_2D, 0);
-}
+    for (size_t begin = 0; begin < queue.order.size(); )
+    {
+        size_t count = queue.runLength(begin);
+        GLuint program = gUberShader ? gUberInstancedProgram : gInstancedProgram[queue.order[begin].material()];
 
+        UseProgram(program);
+        glUniformMatrix4fv(Uniforms(program).orthoMat, 1, GL_FALSE, glm::value_ptr(orthoMat));
 
-int getRandomIndex() {
-    int num = (rand() % (2 - 0 + 1)) + 0;
-    if (num==2) {num=3;}
-    return num;
-}
+        // one mat4 attribute is four vec4 columns
+        for (int c = 0; c < 4; ++c)
+        {
+            SetVertexAttribPointer(3 + c, 4, GL_FLOAT, GL_FALSE, sizeof(glm::mat4), BUFFER_OFFSET(begin * sizeof(glm::mat4) + c * sizeof(glm::vec4)));
+        }
+        if (gUberShader)
+        {
+            SetVertexAttribPointer(7, 1, GL_UNSIGNED_BYTE, GL_FALSE, sizeof(GLubyte), BUFFER_OFFSET(matrixBytes + begin));
+        }
+        drawLod(queue.order[begin].lod(), count);
+        begin += count;
+    }
 
+    // the other programs don't read 3..7, keep them out of their draws
+    for (int c = 0; c < 4; ++c)
+    {
+        glVertexAttribDivisor(3 + c, 0);
+        glDisableVertexAttribArray(3 + c);
+    }
+    if (gUberShader)
+    {
+        glVertexAttribDivisor(7, 0);
+        glDisableVertexAttribArray(7);
+    }
+}
 
+/// The board turns this fast, whatever the frame rate: 0.5 degrees a frame at 60 fps
+const double kDegreesPerSecond = 30;
 
-void display(vector<vector<GLuint>>& progs)
+/// Draws the latest board as it looks animationSeconds into the run
+void display(double animationSeconds)
 {
+    PROFILE_GPU_SCOPE("display");
+    BeginFrameStats();
+
     glClearColor(0, 0, 0, 1);
     glClearDepth(1.0f);
     glClearStencil(0);
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT);
 
-	static float angle = 0;
+    float angle = fmod(kDegreesPerSecond * animationSeconds, 360);
 
-    glm::mat4 R,S,T;
     float aspect_ratio = 1.*gHeight/gWidth;
-    double xprime, yprime;
-    int curr_idx = 0;
-    colorMatch();
-
-    for(int m = 0; m < grid.size(); m++) {
-                for(int n = 0; n < grid[0].size(); n++) {
-                    if(!grid[m][n].enabled) {
-                        struct Obj tmp;
-                        GLuint tmp_prog;
-                        for(int k = m; k > 0; k--) {
-                            tmp = grid[k-1][n];
-                            
-                            grid[k-1][n] = grid[k][n];
-                            
-                            grid[k][n] = tmp;
-
-                            tmp_prog = progs[k-1][n];
-                            progs[k-1][n] = progs[k][n];
-                            progs[k][n] = tmp_prog;
-                        }
-
-                        
-                        int idx = getRandomIndex();
-                        GLuint prog = gProgram[idx];
-                        progs[0][n] = prog;
-                        grid[0][n].color = idx;
-                        grid[0][n].enabled = true;
-                    }
-                }
-            }
-
-    for(int i = 0; i < rs; i++){
-        for(int j = 0; j < cs; j++){
-            
-            glUseProgram(progs[i][j]);
-            double xt,yt;
-
-            xt = (j)*(20./cs)-10+1.5;
-            yt = 10-i*(20./rs)-1.5;
-            T = glm::translate(glm::mat4(1.f), glm::vec3(xt,yt, -10.f));
-            R = glm::rotate(glm::mat4(1.f), glm::radians(angle), glm::vec3(0, 1, 0));
-            S = glm::scale(glm::mat4(1.f), glm::vec3(aspect_ratio/2,aspect_ratio/2, aspect_ratio/2));
-
-            if(flag){
-                xprime = (double)(xt + 10)/20*640;
-                yprime = (double)(-yt + 10)/20*600;
-                grid[i][j].xpos = xprime;
-                grid[i][j].ypos = yprime;
-                std::cout<<"bunny_xpos: "<<j <<" bunny_ypos: "<<i<<std::endl;
-                std::cout<<"xprime: "<<xprime<<" yprime: "<<yprime<<std::endl;
-            }
-
-            if(grid[i][j].matched && grid[i][j].enabled){
-                
-                int start_index = grid[i][j].match_start_index;
-                int count = grid[i][start_index].match_count;
-                std::cout<<"Bubbling: "<<i<<" "<<j<<" "<<start_index<<" "<<count<<" many bunnies\n";
-                if(grid[i][start_index].msc<200){
-                    S = glm::scale(glm::mat4(1.f), glm::vec3(grid[i][start_index].msc/200,grid[i][start_index].msc/200,grid[i][start_index].msc/200));
-                    grid[i][start_index].msc++;
-                }else{
-                    grid[i][start_index].msc = 0;
-                    for(int it = 0; it <= count;it++){
-                        grid[i][start_index+it].matched = false;
-                        grid[i][start_index+it].enabled = false;
-                        score++;
-                    }
-                }
-            }
-
-            if(grid[i][j].selected){
-                // first element
-                static double sc = 0;
-                if(sc<100){
-                    S = glm::scale(glm::mat4(1.f), glm::vec3(sc/100,sc/100,sc/100));
-                    sc++;
-                }else{
-                    grid[i][j].selected = false;
-                    sc = 0;
-                    score++;
-                    grid[i][j].enabled = false;
-                }
-            }
-            if(grid[i][j].enabled){
-                glm::mat4 modelMat = T * R * S;
-                glm::mat4 modelMatInv = glm::transpose(glm::inverse(modelMat));
-                glm::mat4 perspMat = glm::perspective(glm::radians(45.0f), 1.f, 1.f, 100.0f);
-                glm::mat4 orthoMat = glm::ortho(-10.f, 10.f, -10.f, 10.f, -20.f, 20.f);
-
-                glUniformMatrix4fv(glGetUniformLocation(progs[i][j], "modelingMat"), 1, GL_FALSE, glm::value_ptr(modelMat));
-                glUniformMatrix4fv(glGetUniformLocation(progs[i][j], "modelingMatInvTr"), 1, GL_FALSE, glm::value_ptr(modelMatInv));
-                glUniformMatrix4fv(glGetUniformLocation(progs[i][j], "orthoMat"), 1, GL_FALSE, glm::value_ptr(orthoMat));
-                
-                drawModel();
+    // never blocks; the simulation may be several steps ahead or none since the last frame
+    const BoardSnapshot& board = gSimulation.latest();
+    // per-cell translations are cached; the rotation is shared by all cells
+    gTransforms.beginFrame(board.rows, board.cols, angle);
+
+    // the ortho projection maps 20 world units to the window; meshes larger
+    // than their cell are mostly hidden by the neighbours, so on big boards
+    // the cell pitch rather than the mesh bounds how much detail can show
+    float pixelsPerWorldUnit = min(gWidth, gHeight) / 20.f;
+    float cellPixels = min((float) gWidth / board.cols, (float) gHeight / board.rows);
+    float restingScale = aspect_ratio/2;
+    int restingLod = selectLod(min(restingScale * pixelsPerWorldUnit, cellPixels / gMeshDiameter));
+    auto drawStart = chrono::steady_clock::now();
+
+    // visible cells are queued here and drawn after the loop, grouped by program
+    static RenderQueue queue;
+    queue.clear();
+    queue.sortByMaterial = !gUberShader;
+
+    for(int i = 0; i < board.rows; i++){
+        for(int j = 0; j < board.cols; j++){
+            const CellView& cell = board.cell(i, j);
+            if(cell.visible){
+                // shrinking cells may get by with less
+                float scale = cell.scale < 0 ? restingScale : cell.scale;
+                int lod = cell.scale < 0 ? restingLod : selectLod(min(scale * pixelsPerWorldUnit, cellPixels / gMeshDiameter));
+                queue.add(cell.color, gTransforms.model(i, j, scale), lod);
             }
-            curr_idx += 1;
         }
     }
 
-    flag = false;
+    // instancing needs the grouping, the per-cell loop only benefits from it
+    if(gInstanced || gSortDraws){
+        queue.sort();
+    }
+    const glm::mat4& orthoMat = OrthoMatrix();
+    if(gInstanced){
+        drawModelInstanced(queue, orthoMat);
+    }else{
+        drawQueue(queue, orthoMat);
+    }
 
     assert(glGetError() == GL_NO_ERROR);
 
-    std::string moves_str = "Moves: " + std::to_string(moves);
-    std::string scores_str = "Score: " + std::to_string(score);
-    renderText(moves_str, 0, 0, 1, glm::vec3(1,1,0));
-    renderText(scores_str,300,0,1, glm::vec3(1,1,0));
+    auto textStart = chrono::steady_clock::now();
+    // both HUD strings share one batch, laid out again only when a value changes
+    static TextBatch hud;
+    static int hudMoves = -1, hudScore = -1;
+    if(board.moves != hudMoves || board.score != hudScore){
+        std::string moves_str = "Moves: " + std::to_string(board.moves);
+        std::string scores_str = "Score: " + std::to_string(board.score);
+        hud.clear();
+        hud.color = glm::vec3(1,1,0);
+        hud.append(moves_str, 0, 0, 1);
+        hud.append(scores_str,300,0,1);
+        hudMoves = board.moves;
+        hudScore = board.score;
+    }
+    drawTextBatch(hud);
     assert(glGetError() == GL_NO_ERROR);
+    auto end = chrono::steady_clock::now();
 
-	angle += 0.5;
+    gSectionTimes.drawLoop = elapsedMs(drawStart, textStart);
+    gSectionTimes.text = elapsedMs(textStart, end);
 }
 
 void reshape(GLFWwindow* window, int w, int h)
@@ -741,6 +736,16 @@ void reshape(GLFWwindow* window, int w, int h)
     glViewport(0, 0, w, h);
 }
 
+/// Passes gIntensity to the programs that shade with it
+void updateIntensity()
+{
+    for (const ReloadableProgram& reloadable : gReloadablePrograms)
+    {
+        UseProgram(*reloadable.slot);
+        glUniform1f(Uniforms(*reloadable.slot).intensity, gIntensity);
+    }
+}
+
 void keyboard(GLFWwindow* window, int key, int scancode, int action, int mods)
 {
     if (key == GLFW_KEY_ESCAPE && action == GLFW_PRESS)
@@ -750,60 +755,229 @@ void keyboard(GLFWwindow* window, int key, int scancode, int action, int mods)
     else if (key == GLFW_KEY_F && action == GLFW_PRESS)
     {
         cout << "F pressed" << endl;
-        glUseProgram(gProgram[1]);
+        UseProgram(gProgram[1]);
     }
     else if (key == GLFW_KEY_V && action == GLFW_PRESS)
     {
         cout << "V pressed" << endl;
-        glUseProgram(gProgram[0]);
+        UseProgram(gProgram[0]);
+    }
+    else if (key == GLFW_KEY_P && action == GLFW_PRESS)
+    {
+        cout << "Last frame: " << gLastFrameStats.drawCalls << " draws, "
+             << gLastFrameStats.programSwitches << " program switches, "
+             << gLastFrameStats.bufferBinds << " buffer binds, "
+             << gLastFrameStats.attribPointerCalls << " attrib pointer calls, "
+             << gLastFrameStats.meshTriangles << " mesh triangles, "
+             << gLastFrameStats.avoidedCalls << " redundant calls skipped" << endl;
+    }
+    else if (key == GLFW_KEY_I && action == GLFW_PRESS)
+    {
+        gInstanced = !gInstanced && gInstancingSupported;
+        cout << "Instanced drawing " << (gInstanced ? "on" : "off") << endl;
+    }
+    else if (key == GLFW_KEY_U && action == GLFW_PRESS)
+    {
+        gUberShader = !gUberShader && gUberShaderSupported;
+        cout << "Uber shader " << (gUberShader ? "on" : "off") << endl;
+    }
+    else if (key == GLFW_KEY_M && action == GLFW_PRESS)
+    {
+        // uncapped, vsync, adaptive, capped, skipping adaptive where it falls back to vsync
+        PacingMode next = PacingMode((gFramePacer.mode() + 1) % 4);
+        gFramePacer.setMode(next, gCapFps);
+        if (gFramePacer.mode() != next)
+        {
+            gFramePacer.setMode(PacingMode((next + 1) % 4), gCapFps);
+        }
+        cout << "Frame pacing: " << gFramePacer.modeName() << endl;
     }
     else if (key == GLFW_KEY_D && action == GLFW_PRESS)
     {
         cout << "D pressed" << endl;
         gIntensity /= 1.5;
         cout << "gIntensity = " << gIntensity << endl;
-        glUseProgram(gProgram[0]);
-        glUniform1f(gIntensityLoc, gIntensity);
+        updateIntensity();
     }
     else if (key == GLFW_KEY_B && action == GLFW_PRESS)
     {
         cout << "B pressed" << endl;
         gIntensity *= 1.5;
         cout << "gIntensity = " << gIntensity << endl;
-        glUseProgram(gProgram[0]);
-        glUniform1f(gIntensityLoc, gIntensity);
+        updateIntensity();
     }
 }
 
 void mainLoop(GLFWwindow* window)
 {
-    vector<vector<GLuint>> progs;
-    for(int i = 0; i < rs; i++) {
-        vector<GLuint> empty_vec;
-        progs.push_back(empty_vec);
-        for(int j = 0; j < cs; j++) {
-            GLuint dum = 0;
-            progs[i].push_back(dum);
-        }
-    }
-    for(int i = 0; i < rs; i++) {
-        for(int j = 0; j < cs; j++) {
-            int idx = getRandomIndex();
-            GLuint prog = gProgram[idx];
-            progs[i][j] = prog;
-            grid[i][j].color = idx;
-        }
+    gSimulation.reset(rs, cs);
+    gSimulation.start();
+    // edits to the board shaders show up without a restart
+    for (size_t i = 0; i < gReloadablePrograms.size(); ++i)
+    {
+        gShaderWatcher.watch(i, gReloadablePrograms[i].source);
     }
+    gShaderWatcher.start();
+    gFramePacer.start();
     while (!glfwWindowShouldClose(window))
     {
-        display(progs);
+        gFramePacer.beginFrame();
+        pollShaderReloads();
+        display(gFramePacer.animationTime());
+        gFramePacer.endFrame();
         glfwSwapBuffers(window);
         glfwPollEvents();
+        ProfileCollectGpu();
+    }
+    gFramePacer.stop();
+    gShaderWatcher.stop();
+    gSimulation.stop();
+
+    if (gFrameStatsOnExit)
+    {
+        gFramePacer.printStats();
+    }
+}
+
+/// Renders a few board sizes with each draw path and prints the average
+/// frame time plus the draws and program switches of the last frame.
+/// Frames are not presented, and the simulation is stepped once per frame.
+void benchmarkDrawPaths()
+{
+    const int sizes[] = { 10, 25, 50, 100 };
+    const int warmupFrames = 5, timedFrames = 30;
+    struct { const char* name; bool instanced, sorted, uber; } paths[] = {
+        { "per-cell, row-major", false, false, false },
+        { "per-cell, sorted", false, true, false },
+        { "per-cell, uber", false, true, true },
+        { "instanced", true, true, false },
+        { "instanced, uber", true, true, true },
+    };
+    int savedRs = rs, savedCs = cs;
+    bool savedInstanced = gInstanced, savedSort = gSortDraws, savedUber = gUberShader;
+
+    // matches and selections are logged; keep that out of the numbers
+    int savedLogLevel = gLogLevel.exchange(LOG_LEVEL_WARN);
+    printf("   grid   path                  ms/frame   draws  program switches\n");
+    for (int n : sizes)
+    {
+        for (const auto& path : paths)
+        {
+            if (path.instanced && !gInstancingSupported) continue;
+            if (path.uber && !gUberShaderSupported) continue;
+
+            gInstanced = path.instanced;
+            gSortDraws = path.sorted;
+            gUberShader = path.uber;
+            rs = cs = n;
+            srand(1);
+            gSimulation.reset(n, n);
+
+            // the benchmarks animate by one simulation step a frame
+            for (int f = 0; f < warmupFrames; ++f)
+            {
+                gSimulation.step();
+                display(f * Simulation::kStepSeconds);
+            }
+            glFinish();
+
+            auto start = chrono::steady_clock::now();
+            for (int f = 0; f < timedFrames; ++f)
+            {
+                gSimulation.step();
+                display((warmupFrames + f) * Simulation::kStepSeconds);
+            }
+            glFinish();
+            double ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count() / timedFrames;
+
+            BeginFrameStats(); // publish the last frame's counters
+            printf("%4dx%-4d %-20s %9.2f %7d %17d\n", n, n, path.name, ms,
+                   gLastFrameStats.drawCalls, gLastFrameStats.programSwitches);
+        }
+    }
+    gLogLevel = savedLogLevel;
+
+    rs = savedRs;
+    cs = savedCs;
+    gInstanced = savedInstanced;
+    gSortDraws = savedSort;
+    gUberShader = savedUber;
+}
+
+/// Value below which p percent of values lie (nearest rank)
+static double percentile(vector<double> values, double p)
+{
+    sort(values.begin(), values.end());
+    size_t rank = (size_t) (p / 100 * values.size() + 0.5);
+    return values[min(max(rank, (size_t) 1), values.size()) - 1];
+}
+
+/// --bench: renders numFrames frames of a fixed random board as fast as
+/// possible, selecting a different cell every clickInterval frames, and prints
+/// frame time percentiles and how the CPU time of a frame was split.
+/// Every frame is one simulation step plus display(), ending with glFinish
+/// so the GPU (or llvmpipe) work is included.
+void runBenchmark(int numFrames)
+{
+    const int clickInterval = 25;
+
+    // matches and selections are logged; keep that out of the numbers
+    int savedLogLevel = gLogLevel.exchange(LOG_LEVEL_WARN);
+    srand(1);
+    gSimulation.reset(rs, cs);
+
+    vector<double> frameMs(numFrames);
+    vector<double> sectionMs[4];
+    int clicks = 0;
+    for (int f = 0; f < numFrames; ++f)
+    {
+        if (f > 0 && f % clickInterval == 0)
+        {
+            int k = f / clickInterval;
+            gSimulation.select((k * 7) % rs, (k * 11) % cs);
+            ++clicks;
+        }
+
+        auto start = chrono::steady_clock::now();
+        gSimulation.step();
+        display(f * Simulation::kStepSeconds);
+        glFinish();
+        frameMs[f] = elapsedMs(start, chrono::steady_clock::now());
+        ProfileCollectGpu();
+
+        sectionMs[0].push_back(gSimulation.lastStepTimes().colorMatch);
+        sectionMs[1].push_back(gSimulation.lastStepTimes().gridUpdate);
+        sectionMs[2].push_back(gSectionTimes.drawLoop);
+        sectionMs[3].push_back(gSectionTimes.text);
+    }
+    gLogLevel = savedLogLevel;
+
+    double totalMs = 0;
+    for (double ms : frameMs) totalMs += ms;
+
+    printf("%d frames of a %dx%d board, %d clicks, %s (%s, %s)\n", numFrames, rs, cs, clicks,
+           (const char*) glGetString(GL_RENDERER), gInstanced ? "instanced" : "per-cell draws",
+           gUberShader ? "uber shader" : "program per material");
+    printf("frame time ms: p50 %.3f  p95 %.3f  p99 %.3f  (mean %.3f, %.1f fps)\n",
+           percentile(frameMs, 50), percentile(frameMs, 95), percentile(frameMs, 99),
+           totalMs / numFrames, 1000 * numFrames / totalMs);
+    BeginFrameStats(); // publish the last frame's counters
+    printf("last frame: %ld mesh triangles in %d draws, %d program switches\n", gLastFrameStats.meshTriangles,
+           gLastFrameStats.drawCalls, gLastFrameStats.programSwitches);
+
+    const char* names[4] = { "colorMatch", "grid update", "draw loop", "HUD text" };
+    printf("CPU ms/frame        mean       p50       p95       p99\n");
+    for (int s = 0; s < 4; ++s)
+    {
+        double sum = 0;
+        for (double ms : sectionMs[s]) sum += ms;
+        printf("%-12s %11.3f %9.3f %9.3f %9.3f\n", names[s], sum / numFrames,
+               percentile(sectionMs[s], 50), percentile(sectionMs[s], 95), percentile(sectionMs[s], 99));
     }
 }
 
 static void cursor_position_callback(GLFWwindow *window, double xpos, double ypos){
-    std::cout<<"Cursor xpos: "<<xpos<<" ypos: "<<ypos<<std::endl;
+    LOG_TRACE("Cursor xpos: %g ypos: %g", xpos, ypos);
 }
 
 static void mouse_button_callback(GLFWwindow *window, int button, int action, int mods){
@@ -811,43 +985,135 @@ static void mouse_button_callback(GLFWwindow *window, int button, int action, in
         double xpos, ypos;
 
         glfwGetCursorPos(window, &xpos, &ypos);
+        LOG_DEBUG("cursor position at: xpos: %g ypos: %g", xpos, ypos);
 
-        std::cout<<"cursor position at: xpos: "<<xpos<<" ypos: "<<ypos<<std::endl;
-        for (int i = 0; i < rs; i++)
-        {
-            for (int j = 0; j < cs; j++)
-            {
-                double obj_xpos = grid[i][j].xpos;
-                double obj_ypos = grid[i][j].ypos;
-                std::cout<<obj_xpos<<" "<<obj_ypos<<std::endl;
-                if(obj_xpos - 15 < xpos && xpos < obj_xpos+15 && obj_ypos - 15 < ypos && ypos < obj_ypos+15){
-                    grid[i][j].selected = true;
-                    moves++;
-                    std::cout<<"selected: "<<i<<" "<<j<<std::endl;
-                }
-            }
-            
+        // the layout follows the window size, so this stays right after a reshape
+        int i, j;
+        if(PickCell(rs, cs, gWidth, gHeight, xpos, ypos, i, j)){
+            gSimulation.select(i, j);
         }
-        
     }
 }
 
 int main(int argc, char** argv)   // Create Main Function For Bringing It All Together
 {
-    if(argc != 4){
-        std::cout<<"Correct usage: ./hw3 [row_size] [column_size] [.obj file]\n";
+    if(argc < 4){
+        std::cout<<"Correct usage: ./hw3 [row_size] [column_size] [.obj file] [options]\n"
+                 <<"  --threads N     number of OBJ parser threads (default: one per core)\n"
+                 <<"  --bench-load    time OBJ loading with 1..N threads and exit\n"
+                 <<"  --no-cache      neither read nor write the on-disk caches\n"
+                 <<"  --no-instancing draw the board with one draw call per cell\n"
+                 <<"  --no-sort       draw cells in row-major order instead of grouped by program\n"
+                 <<"  --uber-shader   draw all materials with one program reading a material buffer\n"
+                 <<"  --packed-vertices  upload 16-bit positions and octahedral normals (12 bytes a vertex)\n"
+                 <<"  --no-lod        always draw the full resolution mesh\n"
+                 <<"  --uint-indices  upload 32-bit indices even where 16 bits would do\n"
+                 <<"  --pacing MODE   uncapped, vsync (default), adaptive, or a frame rate cap such as 30\n"
+                 <<"  --frame-stats   print histograms of the window's frame times on exit\n"
+                 <<"  --profile FILE  write CPU and GPU profiling scopes to FILE on exit, as Chrome trace JSON\n"
+                 <<"                  for about:tracing or ui.perfetto.dev\n"
+                 <<"  --bench-draw    compare frame times of the draw paths and exit\n"
+                 <<"  --bench-transforms  time building the per-cell matrices and exit\n"
+                 <<"  --bench-match   time finding runs with and without bitboards and exit\n"
+                 <<"  --bench         render offscreen without a window, print frame times and exit\n"
+                 <<"  --frames N      number of frames --bench renders (default 500)\n";
         exit(1);
     }
     rs = atoi(argv[1]);
     cs = atoi(argv[2]);
     filename = std::string(argv[3]);
-    // init grid
-    grid.resize(rs);
-    for(size_t i = 0; i < rs; i++){
-        grid[i] = std::vector<Obj>(cs);
-        // for(size_t j = 0; j < cs; j++){
-        //     grid[i].push_back(Obj());
-        // }
+
+    bool benchLoad = false, benchDraw = false, benchTransforms = false, benchMatch = false, bench = false;
+    int benchFrames = 500;
+    PacingMode pacingMode = kPacingVsync;
+    std::string profileFile;
+    for(int i = 4; i < argc; i++){
+        std::string arg = argv[i];
+        if(arg == "--threads" && i + 1 < argc){
+            gLoaderThreads = atoi(argv[++i]);
+        }else if(arg == "--bench-load"){
+            benchLoad = true;
+        }else if(arg == "--no-cache"){
+            gCacheEnabled = false;
+        }else if(arg == "--no-instancing"){
+            gInstanced = false;
+        }else if(arg == "--no-sort"){
+            gSortDraws = false;
+        }else if(arg == "--uber-shader"){
+            gUberShader = true;
+        }else if(arg == "--packed-vertices"){
+            gPackedVertices = true;
+        }else if(arg == "--no-lod"){
+            gLodEnabled = false;
+        }else if(arg == "--uint-indices"){
+            gShortIndices = false;
+        }else if(arg == "--pacing" && i + 1 < argc){
+            if(!ParsePacingMode(argv[++i], pacingMode, gCapFps)){
+                std::cout<<"Unknown pacing mode: "<<argv[i]<<"\n";
+                exit(1);
+            }
+        }else if(arg == "--frame-stats"){
+            gFrameStatsOnExit = true;
+        }else if(arg == "--profile" && i + 1 < argc){
+            profileFile = argv[++i];
+        }else if(arg == "--bench-transforms"){
+            benchTransforms = true;
+        }else if(arg == "--bench-match"){
+            benchMatch = true;
+        }else if(arg == "--bench-draw"){
+            benchDraw = true;
+        }else if(arg == "--bench"){
+            bench = true;
+        }else if(arg == "--frames" && i + 1 < argc){
+            benchFrames = max(atoi(argv[++i]), 1);
+        }else{
+            std::cout<<"Unknown option: "<<arg<<"\n";
+            exit(1);
+        }
+    }
+
+    // before any thread starts, so the scopes can read gProfiling unsynchronized
+    if(!profileFile.empty()){
+        ProfileEnable();
+        ProfileThreadName("main");
+    }
+
+    if(benchLoad){
+        BenchmarkObjLoad(filename, gLoaderThreads);
+        if(!profileFile.empty()) ProfileWrite(profileFile);
+        return 0;
+    }
+    if(benchTransforms){
+        BenchmarkTransforms();
+        return 0;
+    }
+    if(benchMatch){
+        BenchmarkMatch();
+        return 0;
+    }
+    if(bench){
+        // no window, so no display server and no vsync
+        HeadlessContext headless;
+        if(!headless.create()){
+            return EXIT_FAILURE;
+        }
+        GLenum glewStatus = glewInit();
+#ifdef GLEW_ERROR_NO_GLX_DISPLAY
+        // a GLX build of GLEW has loaded the GL functions by the time it looks for a GLX display
+        if(glewStatus == GLEW_ERROR_NO_GLX_DISPLAY) glewStatus = GLEW_OK;
+#endif
+        if(glewStatus != GLEW_OK || !headless.createFramebuffer(gWidth, gHeight)){
+            std::cout << "Failed to set up offscreen rendering" << std::endl;
+            headless.destroy();
+            return EXIT_FAILURE;
+        }
+        glViewport(0, 0, gWidth, gHeight);
+
+        init();
+        runBenchmark(benchFrames);
+        if(!profileFile.empty()) ProfileWrite(profileFile);
+        headless.destroy();
+        return 0;
     }
 
 
@@ -871,7 +1137,7 @@ int main(int argc, char** argv)   // Create Main Function For Bringing It All To
     }
 
     glfwMakeContextCurrent(window);
-    glfwSwapInterval(1);
+    gFramePacer.setMode(pacingMode, gCapFps);
 
     // Initialize GLEW to setup the OpenGL Function pointers
     if (GLEW_OK != glewInit())
@@ -894,7 +1160,15 @@ int main(int argc, char** argv)   // Create Main Function For Bringing It All To
     glfwSetMouseButtonCallback(window, mouse_button_callback);
 
     reshape(window, gWidth, gHeight); // need to call this once ourselves
-    mainLoop(window); // this does not return unless the window is closed
+    if(benchDraw){
+        glfwSwapInterval(0);
+        benchmarkDrawPaths();
+    }else{
+        mainLoop(window); // this does not return unless the window is closed
+    }
+    if(!profileFile.empty()){
+        ProfileWrite(profileFile);
+    }
 
     glfwDestroyWindow(window);
     glfwTerminate();
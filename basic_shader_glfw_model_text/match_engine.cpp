@@ -0,0 +1,98 @@
+#include "match_engine.h"
+#include "board.h"
+#include "log.h"
+#include "profile.h"
+
+using namespace std;
+
+void MatchEngine::reset(int numRows, int numCols)
+{
+    rows = numRows;
+    cols = numCols;
+    isDirty.assign(rows * cols, 1);
+    dirty.resize(rows * cols);
+    for (int n = 0; n < rows * cols; ++n)
+    {
+        dirty[n] = n;
+    }
+}
+
+void MatchEngine::markDirty(int i, int j)
+{
+    int n = i * cols + j;
+    if (!isDirty[n])
+    {
+        isDirty[n] = 1;
+        dirty.push_back(n);
+    }
+}
+
+int MatchEngine::findMatches(Board& board)
+{
+    PROFILE_SCOPE("MatchEngine::findMatches");
+    // walking out from a cell costs a few cell reads, the full scan about a
+    // word per 64 cells and color
+    bool fullScan = dirty.size() * 8 > (size_t) rows * cols;
+
+    // collect first and mark afterwards, so that a cell matched through one
+    // dirty cell still extends runs found through another
+    runCells.clear();
+    if (fullScan)
+    {
+        FindRuns(board, runs);
+        for (int i = 0; i < rows; ++i)
+        {
+            for (int k = 0; k < board.wordsPerRow; ++k)
+            {
+                for (uint64_t bits = runs[i * board.wordsPerRow + k]; bits; bits &= bits - 1)
+                {
+                    runCells.push_back(board.index(i, k * 64 + __builtin_ctzll(bits)));
+                }
+            }
+        }
+    }
+    else
+    {
+        for (int n : dirty)
+        {
+            int i = n / cols, j = n % cols;
+            int color = board.colors[n];
+            if (!board.isMatchable(i, j, color)) continue;
+
+            int left = j, right = j;
+            while (left > 0 && board.isMatchable(i, left - 1, color)) --left;
+            while (right < cols - 1 && board.isMatchable(i, right + 1, color)) ++right;
+            if (right - left + 1 >= 3)
+            {
+                for (int k = left; k <= right; ++k) runCells.push_back(board.index(i, k));
+            }
+
+            int top = i, bottom = i;
+            while (top > 0 && board.isMatchable(top - 1, j, color)) --top;
+            while (bottom < rows - 1 && board.isMatchable(bottom + 1, j, color)) ++bottom;
+            if (bottom - top + 1 >= 3)
+            {
+                for (int k = top; k <= bottom; ++k) runCells.push_back(board.index(k, j));
+            }
+        }
+    }
+
+    for (int n : dirty)
+    {
+        isDirty[n] = 0;
+    }
+    dirty.clear();
+
+    int matched = 0;
+    for (int n : runCells)
+    {
+        if (!board.has(n, kMatched))
+        {
+            LOG_DEBUG("Matched %d %d color %d", n / cols, n % cols, board.colors[n]);
+            board.setFlags(n, board.flags[n] | kMatched);
+            board.bubbleSteps[n] = 0;
+            ++matched;
+        }
+    }
+    return matched;
+}
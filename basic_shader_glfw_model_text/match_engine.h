@@ -0,0 +1,41 @@
+#ifndef MATCH_ENGINE_H
+#define MATCH_ENGINE_H
+
+#include <cstdint>
+#include <vector>
+
+struct Board;
+
+/// Finds runs of three or more cells of the same color, horizontally and
+/// vertically. Only the rows and columns through cells that changed since
+/// the last call are looked at, and only as far as the run through the
+/// changed cell reaches, so the cost follows the number of changed cells
+/// rather than the board size.
+///
+/// When a large part of the board changed at once (a new board, a big
+/// refill) it is cheaper to scan all of it with FindRuns on the bitmasks.
+///
+/// Cells that are matched (bubbling) or selected are locked: they neither
+/// start nor extend a run until they have been removed and refilled.
+class MatchEngine
+{
+public:
+    /// Makes every cell of a rows x cols board dirty
+    void reset(int numRows, int numCols);
+
+    /// Cell (i, j) got a new color or moved
+    void markDirty(int i, int j);
+
+    /// Sets kMatched (and resets bubbleSteps) on the cells of every run through
+    /// a dirty cell and clears the dirty set. Returns the number of cells matched.
+    int findMatches(Board& board);
+
+private:
+    int rows = 0, cols = 0;
+    std::vector<char> isDirty; // row-major
+    std::vector<int> dirty;    // cell indices, each at most once
+    std::vector<int> runCells;
+    std::vector<uint64_t> runs; // FindRuns output
+};
+
+#endif
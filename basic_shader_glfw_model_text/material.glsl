@@ -0,0 +1,66 @@
+// Inserted by createVS and createFS after the #version line of the uber
+// shaders, ahead of vertex_format.glsl. Mirrors struct Material in material.h.
+// UBER_VERTEX_SHADER is defined for the vertex shaders.
+#extension GL_ARB_uniform_buffer_object : require
+
+struct Material
+{
+	vec4 kd;
+	vec4 ka;
+	vec4 ks;
+	float shininess;
+	float shading;        // 0: per vertex, 1: per pixel
+	float falloff;        // 1: intensity / d^2, 0: lightIntensity
+	float lightIntensity;
+};
+
+layout(std140) uniform Materials
+{
+	Material materials[4];
+};
+
+const vec3 lightPos = vec3(5, 5, 5);
+const vec3 eyePos = vec3(0, 0, 0);
+const vec3 Iamb = vec3(0.8, 0.8, 0.8);
+
+uniform float intensity;
+
+varying float fragMaterial; // the same at every vertex of a triangle
+varying vec4 fragPos;
+varying vec3 N;
+varying vec3 vertexColor;   // of per vertex materials
+
+/// Blinn-Phong at world position p with normal N, as the gProgram shaders do it
+vec3 shade(Material m, vec3 p, vec3 N)
+{
+	vec3 Lorg = lightPos - p;
+	vec3 L = normalize(Lorg);
+	vec3 V = normalize(eyePos - p);
+	vec3 H = normalize(L + V);
+	float NdotL = dot(N, L);
+	float NdotH = dot(N, H);
+
+	vec3 I = m.falloff > 0.5 ? vec3(intensity) / dot(Lorg, Lorg) : vec3(m.lightIntensity);
+	vec3 diffuseColor = I * m.kd.rgb * max(0.0, NdotL);
+	vec3 ambientColor = Iamb * m.ka.rgb;
+	vec3 specularColor = I * m.ks.rgb * pow(max(0.0, NdotH), m.shininess);
+	return diffuseColor + ambientColor + specularColor;
+}
+
+#ifdef UBER_VERTEX_SHADER
+
+/// Sets the varyings for material id at world position p
+void shadeVertex(int id, vec4 p, vec3 normal)
+{
+	fragMaterial = float(id);
+	fragPos = p;
+	N = normalize(normal);
+	vertexColor = vec3(0);
+	if (materials[id].shading < 0.5)
+	{
+		// gl_FrontColor was clamped before interpolation, keep that
+		vertexColor = clamp(shade(materials[id], vec3(p), N), 0.0, 1.0);
+	}
+}
+
+#endif
@@ -0,0 +1,37 @@
+#ifndef MATERIAL_H
+#define MATERIAL_H
+
+#include <GL/glew.h>
+
+/// How a material is shaded; the values are those of Material::shading
+enum Shading
+{
+    kShadingPerVertex = 0, // Gouraud, as vert0/frag0
+    kShadingPerPixel = 1,  // Blinn-Phong per fragment, as vert1/frag1
+};
+
+/// One entry of the Materials uniform block in material.glsl (std140, so
+/// every member is padded to a vec4)
+struct Material
+{
+    GLfloat kd[4];
+    GLfloat ka[4];
+    GLfloat ks[4];
+    GLfloat shininess;
+    GLfloat shading;
+    GLfloat falloff;        // 1: the light is the intensity uniform over the squared distance
+    GLfloat lightIntensity; // used when falloff is 0
+};
+
+/// Materials of the board, indexed like gProgram (a cell's color). Each one
+/// reproduces the constants of the shader pair gProgram uses for it; slot 2
+/// is the text program and stays unused.
+const int kMaterialCount = 4;
+const Material kBoardMaterials[kMaterialCount] = {
+    { { 0.7f, 0, 0.2f, 0 }, { 0.1f, 0.1f, 0.1f, 0 }, { 0.8f, 0.8f, 0.8f, 0 }, 20, kShadingPerVertex, 1, 0 },
+    { { 0.2f, 0, 0.7f, 0 }, { 0.1f, 0.1f, 0.1f, 0 }, { 0.8f, 0.8f, 0.8f, 0 }, 20, kShadingPerPixel, 0, 2 },
+    { },
+    { { 0, 0.5f, 0, 0 }, { 0.1f, 0.1f, 0.1f, 0 }, { 0.8f, 0.8f, 0.8f, 0 }, 20, kShadingPerPixel, 0, 2 },
+};
+
+#endif
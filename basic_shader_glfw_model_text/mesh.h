@@ -0,0 +1,47 @@
+#ifndef MESH_H
+#define MESH_H
+
+#include <vector>
+#include <GL/glew.h>
+
+struct Vertex
+{
+    Vertex(GLfloat inX, GLfloat inY, GLfloat inZ) : x(inX), y(inY), z(inZ) { }
+    GLfloat x, y, z;
+};
+
+struct Texture
+{
+    Texture(GLfloat inU, GLfloat inV) : u(inU), v(inV) { }
+    GLfloat u, v;
+};
+
+struct Normal
+{
+    Normal(GLfloat inX, GLfloat inY, GLfloat inZ) : x(inX), y(inY), z(inZ) { }
+    GLfloat x, y, z;
+};
+
+struct Face
+{
+	Face(int v[], int t[], int n[]) {
+		vIndex[0] = v[0];
+		vIndex[1] = v[1];
+		vIndex[2] = v[2];
+		tIndex[0] = t[0];
+		tIndex[1] = t[1];
+		tIndex[2] = t[2];
+		nIndex[0] = n[0];
+		nIndex[1] = n[1];
+		nIndex[2] = n[2];
+	}
+    GLuint vIndex[3], tIndex[3], nIndex[3];
+};
+
+// defined in main.cpp, filled in by ParseObj
+extern std::vector<Vertex> gVertices;
+extern std::vector<Texture> gTextures;
+extern std::vector<Normal> gNormals;
+extern std::vector<Face> gFaces;
+
+#endif
@@ -0,0 +1,244 @@
+#include "mesh_cache.h"
+
+#include <algorithm>
+#include <cstring>
+
+using namespace std;
+
+namespace
+{
+
+// 2: triangles and vertices reordered by OptimizeGpuMesh
+// 3: levels of detail
+// 4: 16-bit index ranges
+// 5: levels of detail keep normal seams
+const uint32_t kMeshCacheVersion = 5;
+
+/// On-disk layout: header, source path, zero padding up to a 16 byte
+/// boundary, vertex data, index data, then the GpuIndices: ranges, extra
+/// vertices, 16-bit indices
+struct MeshCacheHeader
+{
+    char magic[4];
+    uint32_t version;
+    uint64_t sourceSize;
+    int64_t sourceMtimeNs;
+    uint32_t vertexCount;
+    uint32_t indexCount;
+    GLfloat bboxMin[3];
+    GLfloat bboxMax[3];
+    uint32_t pathLength;
+    uint32_t lodCount;
+    MeshLod lods[kMaxLods];
+    uint32_t indexType; // GL_UNSIGNED_SHORT or GL_UNSIGNED_INT
+    uint32_t rangeCount;
+    uint32_t extraVertexCount;
+    uint32_t shortIndexCount;
+    int32_t firstRange[kMaxLods];
+    int32_t lodRangeCount[kMaxLods];
+};
+
+size_t dataOffset(uint32_t pathLength)
+{
+    return (sizeof(MeshCacheHeader) + pathLength + 15) & ~(size_t) 15;
+}
+
+string meshCachePath(const FileKey& key)
+{
+    return CacheFilePath("mesh", HashBytes(key.path.data(), key.path.size()), ".bin");
+}
+
+} // namespace
+
+bool IndicesInRange(const GLuint* indices, size_t count, GLuint vertexCount)
+{
+    GLuint highest = 0;
+    for (size_t k = 0; k < count; ++k)
+    {
+        highest = max(highest, indices[k]);
+    }
+    return count == 0 || highest < vertexCount;
+}
+
+void BuildGpuMesh(GpuMesh& mesh)
+{
+    mesh.vertexStorage.resize(gVertices.size() * 6);
+    mesh.indexStorage.resize(gFaces.size() * 3);
+
+    float minX = 1e6, maxX = -1e6;
+    float minY = 1e6, maxY = -1e6;
+    float minZ = 1e6, maxZ = -1e6;
+
+    GLfloat* v = mesh.vertexStorage.data();
+    for (size_t i = 0; i < gVertices.size(); ++i)
+    {
+        v[6*i] = gVertices[i].x;
+        v[6*i+1] = gVertices[i].y;
+        v[6*i+2] = gVertices[i].z;
+        v[6*i+3] = gNormals[i].x;
+        v[6*i+4] = gNormals[i].y;
+        v[6*i+5] = gNormals[i].z;
+
+        minX = std::min(minX, gVertices[i].x);
+        maxX = std::max(maxX, gVertices[i].x);
+        minY = std::min(minY, gVertices[i].y);
+        maxY = std::max(maxY, gVertices[i].y);
+        minZ = std::min(minZ, gVertices[i].z);
+        maxZ = std::max(maxZ, gVertices[i].z);
+    }
+
+    GLuint* idx = mesh.indexStorage.data();
+    for (size_t i = 0; i < gFaces.size(); ++i)
+    {
+        idx[3*i] = gFaces[i].vIndex[0];
+        idx[3*i+1] = gFaces[i].vIndex[1];
+        idx[3*i+2] = gFaces[i].vIndex[2];
+    }
+
+    mesh.file.close();
+    mesh.vertexData = mesh.vertexStorage.data();
+    mesh.vertexCount = gVertices.size();
+    mesh.indexData = mesh.indexStorage.data();
+    mesh.indexCount = mesh.indexStorage.size();
+    mesh.lods[0] = { 0, (GLuint) mesh.indexCount, 0 };
+    mesh.lodCount = 1;
+    mesh.bboxMin[0] = minX; mesh.bboxMin[1] = minY; mesh.bboxMin[2] = minZ;
+    mesh.bboxMax[0] = maxX; mesh.bboxMax[1] = maxY; mesh.bboxMax[2] = maxZ;
+}
+
+bool LoadMeshCache(const string& objFile, GpuMesh& mesh, GpuIndices& indices)
+{
+    FileKey key;
+    if (!gCacheEnabled || !GetFileKey(objFile, key))
+    {
+        return false;
+    }
+
+    MappedFile& file = mesh.file;
+    if (!file.open(meshCachePath(key)) || file.size < sizeof(MeshCacheHeader))
+    {
+        file.close();
+        return false;
+    }
+
+    MeshCacheHeader header;
+    memcpy(&header, file.data, sizeof(header));
+
+    size_t offset = dataOffset(header.pathLength);
+    size_t vertexBytes = (size_t) header.vertexCount * 6 * sizeof(GLfloat);
+    size_t indexBytes = (size_t) header.indexCount * sizeof(GLuint);
+    size_t rangeBytes = (size_t) header.rangeCount * sizeof(IndexRange);
+    size_t extraBytes = (size_t) header.extraVertexCount * sizeof(GLuint);
+    size_t shortBytes = (size_t) header.shortIndexCount * sizeof(GLushort);
+
+    bool valid = memcmp(header.magic, "HW3M", 4) == 0 &&
+                 header.version == kMeshCacheVersion &&
+                 header.sourceSize == key.size &&
+                 header.sourceMtimeNs == key.mtimeNs &&
+                 file.size == offset + vertexBytes + indexBytes + rangeBytes + extraBytes + shortBytes &&
+                 key.path.compare(0, string::npos, file.data + sizeof(header), header.pathLength) == 0 &&
+                 header.lodCount >= 1 && header.lodCount <= kMaxLods &&
+                 (header.indexType == GL_UNSIGNED_SHORT ||
+                  (header.indexType == GL_UNSIGNED_INT && header.extraVertexCount == 0 && header.shortIndexCount == 0));
+    for (uint32_t l = 0; valid && l < header.lodCount; ++l)
+    {
+        valid = (uint64_t) header.lods[l].firstIndex + header.lods[l].indexCount <= header.indexCount &&
+                header.firstRange[l] >= 0 && header.lodRangeCount[l] >= 0 &&
+                (uint64_t) header.firstRange[l] + header.lodRangeCount[l] <= header.rangeCount;
+    }
+    const IndexRange* ranges = (const IndexRange*) (file.data + offset + vertexBytes + indexBytes);
+    uint32_t rangeIndices = header.indexType == GL_UNSIGNED_SHORT ? header.shortIndexCount : header.indexCount;
+    for (uint32_t r = 0; valid && r < header.rangeCount; ++r)
+    {
+        valid = (uint64_t) ranges[r].firstIndex + ranges[r].indexCount <= rangeIndices;
+    }
+    // a bad index would read past the vertices, on the CPU for the extra
+    // vertices (initVBO copies them) and on the GPU for the others
+    const GLuint* extraVertices = (const GLuint*) (file.data + offset + vertexBytes + indexBytes + rangeBytes);
+    const GLushort* shortIndices = (const GLushort*) (file.data + offset + vertexBytes + indexBytes + rangeBytes + extraBytes);
+    valid = valid && IndicesInRange((const GLuint*) (file.data + offset + vertexBytes), header.indexCount, header.vertexCount) &&
+            IndicesInRange(extraVertices, header.extraVertexCount, header.vertexCount);
+    for (uint32_t r = 0; valid && r < header.rangeCount && header.indexType == GL_UNSIGNED_SHORT; ++r)
+    {
+        const IndexRange& range = ranges[r];
+        GLushort highest = 0;
+        for (GLuint k = range.firstIndex; k < range.firstIndex + range.indexCount; ++k)
+        {
+            highest = max(highest, shortIndices[k]);
+        }
+        valid = range.baseVertex >= 0 &&
+                (uint64_t) range.baseVertex + highest < (uint64_t) header.vertexCount + header.extraVertexCount;
+    }
+    if (!valid)
+    {
+        file.close();
+        return false;
+    }
+
+    mesh.vertexData = (const GLfloat*) (file.data + offset);
+    mesh.vertexCount = header.vertexCount;
+    mesh.indexData = (const GLuint*) (file.data + offset + vertexBytes);
+    mesh.indexCount = header.indexCount;
+    memcpy(mesh.bboxMin, header.bboxMin, sizeof(mesh.bboxMin));
+    memcpy(mesh.bboxMax, header.bboxMax, sizeof(mesh.bboxMax));
+    memcpy(mesh.lods, header.lods, sizeof(mesh.lods));
+    mesh.lodCount = header.lodCount;
+
+    // the ranges are a few dozen bytes, the arrays stay in the file
+    indices.type = header.indexType;
+    indices.ranges.assign(ranges, ranges + header.rangeCount);
+    indices.extraVertexData = extraVertices;
+    indices.extraVertexCount = header.extraVertexCount;
+    indices.shortIndexData = shortIndices;
+    indices.shortIndexCount = header.shortIndexCount;
+    copy(header.firstRange, header.firstRange + kMaxLods, indices.firstRange);
+    copy(header.lodRangeCount, header.lodRangeCount + kMaxLods, indices.rangeCount);
+    indices.shortIndexStorage.clear();
+    indices.extraVertexStorage.clear();
+    return true;
+}
+
+bool SaveMeshCache(const string& objFile, const GpuMesh& mesh, const GpuIndices& indices)
+{
+    FileKey key;
+    if (!gCacheEnabled || !GetFileKey(objFile, key))
+    {
+        return false;
+    }
+
+    MeshCacheHeader header = {};
+    memcpy(header.magic, "HW3M", 4);
+    header.version = kMeshCacheVersion;
+    header.sourceSize = key.size;
+    header.sourceMtimeNs = key.mtimeNs;
+    header.vertexCount = mesh.vertexCount;
+    header.indexCount = mesh.indexCount;
+    memcpy(header.bboxMin, mesh.bboxMin, sizeof(header.bboxMin));
+    memcpy(header.bboxMax, mesh.bboxMax, sizeof(header.bboxMax));
+    header.pathLength = key.path.size();
+    header.lodCount = mesh.lodCount;
+    memcpy(header.lods, mesh.lods, sizeof(header.lods));
+    header.indexType = indices.type;
+    header.rangeCount = indices.ranges.size();
+    header.extraVertexCount = indices.extraVertexCount;
+    header.shortIndexCount = indices.shortIndexCount;
+    copy(indices.firstRange, indices.firstRange + kMaxLods, header.firstRange);
+    copy(indices.rangeCount, indices.rangeCount + kMaxLods, header.lodRangeCount);
+
+    static const char padding[16] = {0};
+    const void* parts[] = {
+        &header, key.path.data(), padding, mesh.vertexData, mesh.indexData,
+        indices.ranges.data(), indices.extraVertexData, indices.shortIndexData
+    };
+    size_t sizes[] = {
+        sizeof(header),
+        key.path.size(),
+        dataOffset(header.pathLength) - sizeof(header) - key.path.size(),
+        (size_t) mesh.vertexDataSizeInBytes(),
+        (size_t) mesh.indexDataSizeInBytes(),
+        indices.ranges.size() * sizeof(IndexRange),
+        (size_t) indices.extraVertexCount * sizeof(GLuint),
+        (size_t) indices.shortIndexCount * sizeof(GLushort)
+    };
+    return WriteFileAtomic(meshCachePath(key), parts, sizes, 8);
+}
@@ -0,0 +1,96 @@
+#ifndef MESH_CACHE_H
+#define MESH_CACHE_H
+
+#include <string>
+#include <vector>
+#include "file_util.h"
+#include "mesh.h"
+
+/// One level of detail: a range of GpuMesh::indexData drawn from the shared vertices
+struct MeshLod
+{
+    GLuint firstIndex = 0;
+    GLuint indexCount = 0;
+    GLfloat error = 0; // how far (object space, roughly) the surface moved from level 0
+};
+
+const int kMaxLods = 4;
+
+/// Mesh in the layout initVBO uploads: interleaved position/normal floats
+/// and a triangle index list holding every level of detail back to back,
+/// full detail first. The arrays either point into a mapped cache file or
+/// into the vectors below.
+struct GpuMesh
+{
+    const GLfloat* vertexData = nullptr; // 6 floats per vertex: x y z nx ny nz
+    GLsizei vertexCount = 0;
+    const GLuint* indexData = nullptr;
+    GLsizei indexCount = 0; // all levels
+    GLfloat bboxMin[3] = {0, 0, 0};
+    GLfloat bboxMax[3] = {0, 0, 0};
+    MeshLod lods[kMaxLods];
+    int lodCount = 0;
+
+    std::vector<GLfloat> vertexStorage;
+    std::vector<GLuint> indexStorage;
+    MappedFile file;
+
+    GLsizeiptr vertexDataSizeInBytes() const { return (GLsizeiptr) vertexCount * 6 * sizeof(GLfloat); }
+    GLsizeiptr indexDataSizeInBytes() const { return (GLsizeiptr) indexCount * sizeof(GLuint); }
+};
+
+/// Part of a level of detail drawn with one call: indexCount indices from
+/// firstIndex on, each relative to baseVertex
+struct IndexRange
+{
+    GLuint firstIndex;
+    GLuint indexCount;
+    GLint baseVertex;
+};
+
+/// The index buffer of a GpuMesh in the form initVBO uploads, made by
+/// BuildGpuIndices and cached with the mesh.
+///
+/// Every level is split into ranges that each reference at most 65536
+/// consecutive vertices, so all indices fit 16 bits. A mesh with at most
+/// 65536 vertices needs one range per level with base vertex 0. Larger
+/// meshes get one range per window of 65536 vertices starting at a
+/// multiple of 32768; a triangle goes to the window whose first half holds
+/// its lowest vertex, keeping the order of the level within the window.
+/// The few triangles that span 32768 vertices or more get copies of their
+/// vertices, appended to the vertex buffer.
+///
+/// The arrays either point into the mapped cache file of the mesh or into
+/// the vectors below, like those of GpuMesh.
+struct GpuIndices
+{
+    GLenum type = GL_UNSIGNED_INT;
+    const GLushort* shortIndexData = nullptr; // the indices when type is GL_UNSIGNED_SHORT
+    GLsizei shortIndexCount = 0;
+    const GLuint* extraVertexData = nullptr;  // mesh vertices to copy after the last one, in order
+    GLsizei extraVertexCount = 0;
+    std::vector<IndexRange> ranges;
+    int firstRange[kMaxLods] = {0};           // of each level in ranges
+    int rangeCount[kMaxLods] = {0};
+
+    std::vector<GLushort> shortIndexStorage;
+    std::vector<GLuint> extraVertexStorage;
+
+    size_t indexSize() const { return type == GL_UNSIGNED_SHORT ? sizeof(GLushort) : sizeof(GLuint); }
+};
+
+/// Whether each of the count indices is below vertexCount
+bool IndicesInRange(const GLuint* indices, size_t count, GLuint vertexCount);
+
+/// Interleaves gVertices/gNormals and flattens gFaces into mesh, as its only level
+void BuildGpuMesh(GpuMesh& mesh);
+
+/// Maps the cache entry of objFile into mesh and indices. Returns false on a
+/// miss, i.e. when there is no entry or the .obj changed size or mtime since
+/// it was written.
+bool LoadMeshCache(const std::string& objFile, GpuMesh& mesh, GpuIndices& indices);
+
+/// Stores mesh and its indices as the cache entry of objFile
+bool SaveMeshCache(const std::string& objFile, const GpuMesh& mesh, const GpuIndices& indices);
+
+#endif
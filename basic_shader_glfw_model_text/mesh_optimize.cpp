@@ -0,0 +1,271 @@
+#include "mesh_optimize.h"
+
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+#include <cmath>
+#include <vector>
+#include "mesh_cache.h"
+
+using namespace std;
+
+namespace
+{
+
+/// Triangles of a Tipsify cluster, [begin, end) in the reordered index list
+struct Cluster
+{
+    size_t begin, end;
+    double occlusion; // how far out and outward facing the cluster is
+};
+
+/// Emits the triangles of in[0 .. 3 * triCount) to out by fanning around
+/// one vertex at a time, picking as the next fanning vertex the most
+/// recently used one that will still be in the cache after its remaining
+/// triangles are emitted. When no candidate qualifies it falls back to a
+/// recently used vertex with triangles left or, failing that, the next such
+/// vertex in index order; clusterStarts gets the triangle where each such
+/// restart happened.
+void tipsify(const GLuint* in, size_t triCount, size_t vertexCount,
+             vector<GLuint>& out, vector<size_t>& clusterStarts)
+{
+    // vertex -> adjacent triangles
+    vector<unsigned> offsets(vertexCount + 1, 0);
+    for (size_t k = 0; k < 3 * triCount; ++k)
+    {
+        ++offsets[in[k] + 1];
+    }
+    for (size_t v = 0; v < vertexCount; ++v)
+    {
+        offsets[v + 1] += offsets[v];
+    }
+    vector<unsigned> adjacency(3 * triCount);
+    vector<unsigned> fill(offsets.begin(), offsets.end() - 1);
+    for (size_t k = 0; k < 3 * triCount; ++k)
+    {
+        adjacency[fill[in[k]]++] = k / 3;
+    }
+
+    vector<int> live(vertexCount);
+    for (size_t v = 0; v < vertexCount; ++v)
+    {
+        live[v] = offsets[v + 1] - offsets[v];
+    }
+
+    // a vertex is in the cache if it was added within the last kVertexCacheSize additions
+    vector<unsigned> cacheTime(vertexCount, 0);
+    unsigned time = kVertexCacheSize + 1;
+    vector<char> emitted(triCount, 0);
+    vector<GLuint> deadEnd;
+    vector<GLuint> candidates;
+    size_t cursor = 0;
+
+    auto restart = [&]() -> long {
+        while (!deadEnd.empty())
+        {
+            GLuint v = deadEnd.back();
+            deadEnd.pop_back();
+            if (live[v] > 0) return v;
+        }
+        for (; cursor < vertexCount; ++cursor)
+        {
+            if (live[cursor] > 0) return cursor;
+        }
+        return -1;
+    };
+
+    out.clear();
+    out.reserve(3 * triCount);
+    long fan = restart();
+    bool newCluster = true;
+    while (fan >= 0)
+    {
+        if (newCluster)
+        {
+            clusterStarts.push_back(out.size() / 3);
+            newCluster = false;
+        }
+
+        candidates.clear();
+        for (unsigned a = offsets[fan]; a < offsets[fan + 1]; ++a)
+        {
+            unsigned t = adjacency[a];
+            if (emitted[t]) continue;
+
+            for (int c = 0; c < 3; ++c)
+            {
+                GLuint v = in[3 * t + c];
+                out.push_back(v);
+                deadEnd.push_back(v);
+                candidates.push_back(v);
+                --live[v];
+                if (time - cacheTime[v] > (unsigned) kVertexCacheSize)
+                {
+                    cacheTime[v] = time++;
+                }
+            }
+            emitted[t] = 1;
+        }
+
+        long next = -1;
+        int bestPriority = -1;
+        for (GLuint v : candidates)
+        {
+            if (live[v] <= 0) continue;
+
+            // older is better, as long as fanning around it won't evict it
+            int priority = 0;
+            int age = time - cacheTime[v];
+            if (age + 2 * live[v] <= kVertexCacheSize)
+            {
+                priority = age;
+            }
+            if (priority > bestPriority)
+            {
+                bestPriority = priority;
+                next = v;
+            }
+        }
+        if (next < 0)
+        {
+            next = restart();
+            newCluster = true;
+        }
+        fan = next;
+    }
+}
+
+} // namespace
+
+double ComputeACMR(const GLuint* indices, size_t indexCount, size_t vertexCount)
+{
+    if (indexCount < 3)
+    {
+        return 0;
+    }
+
+    vector<unsigned> cacheTime(vertexCount, 0);
+    unsigned time = 0;
+    size_t misses = 0;
+    for (size_t k = 0; k < indexCount; ++k)
+    {
+        GLuint v = indices[k];
+        if (cacheTime[v] == 0 || time - cacheTime[v] >= (unsigned) kVertexCacheSize)
+        {
+            cacheTime[v] = ++time;
+            ++misses;
+        }
+    }
+    return (double) misses / (indexCount / 3);
+}
+
+void OptimizeTriangleOrder(GLuint* indices, size_t indexCount, size_t vertexCount)
+{
+    vector<GLuint> order;
+    vector<size_t> clusterStarts;
+    tipsify(indices, indexCount / 3, vertexCount, order, clusterStarts);
+    copy(order.begin(), order.end(), indices);
+}
+
+MeshOptimizeStats OptimizeGpuMesh(GpuMesh& mesh)
+{
+    assert(mesh.lodCount == 1);
+    MeshOptimizeStats stats;
+    auto start = chrono::steady_clock::now();
+    size_t triCount = mesh.indexCount / 3;
+    stats.acmrBefore = ComputeACMR(mesh.indexData, mesh.indexCount, mesh.vertexCount);
+
+    vector<GLuint> order;
+    vector<size_t> clusterStarts;
+    tipsify(mesh.indexData, triCount, mesh.vertexCount, order, clusterStarts);
+    clusterStarts.push_back(triCount);
+
+    // clusters facing away from the center and far from it tend to occlude the
+    // others, so draw them first (Tipsify's overdraw pass, hard boundaries only)
+    const GLfloat* v = mesh.vertexData;
+    double center[3] = {0, 0, 0};
+    for (GLsizei i = 0; i < mesh.vertexCount; ++i)
+    {
+        for (int k = 0; k < 3; ++k) center[k] += v[6 * i + k];
+    }
+    for (int k = 0; k < 3; ++k) center[k] /= max(mesh.vertexCount, 1);
+
+    vector<Cluster> clusters;
+    for (size_t c = 0; c + 1 < clusterStarts.size(); ++c)
+    {
+        Cluster cluster = { clusterStarts[c], clusterStarts[c + 1], 0 };
+        if (cluster.begin == cluster.end) continue;
+
+        // area weighted centroid and normal
+        double centroid[3] = {0, 0, 0}, normal[3] = {0, 0, 0}, area = 0;
+        for (size_t t = cluster.begin; t < cluster.end; ++t)
+        {
+            const GLfloat* a = v + 6 * order[3 * t];
+            const GLfloat* b = v + 6 * order[3 * t + 1];
+            const GLfloat* d = v + 6 * order[3 * t + 2];
+            double e1[3] = { b[0] - a[0], b[1] - a[1], b[2] - a[2] };
+            double e2[3] = { d[0] - a[0], d[1] - a[1], d[2] - a[2] };
+            double n[3] = { e1[1] * e2[2] - e1[2] * e2[1], e1[2] * e2[0] - e1[0] * e2[2], e1[0] * e2[1] - e1[1] * e2[0] };
+            double twiceArea = sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+            for (int k = 0; k < 3; ++k)
+            {
+                centroid[k] += twiceArea * (a[k] + b[k] + d[k]) / 3;
+                normal[k] += n[k];
+            }
+            area += twiceArea;
+        }
+        if (area > 0)
+        {
+            for (int k = 0; k < 3; ++k)
+            {
+                cluster.occlusion += (centroid[k] / area - center[k]) * normal[k] / area;
+            }
+        }
+        clusters.push_back(cluster);
+    }
+    stable_sort(clusters.begin(), clusters.end(),
+                [](const Cluster& a, const Cluster& b) { return a.occlusion > b.occlusion; });
+    stats.clusters = clusters.size();
+
+    vector<GLuint> indices;
+    indices.reserve(3 * triCount);
+    for (const Cluster& cluster : clusters)
+    {
+        indices.insert(indices.end(), order.begin() + 3 * cluster.begin, order.begin() + 3 * cluster.end);
+    }
+
+    // number the vertices in order of first use; unreferenced ones are dropped
+    const GLuint unused = ~0u;
+    vector<GLuint> remap(mesh.vertexCount, unused);
+    GLuint vertexCount = 0;
+    for (GLuint& index : indices)
+    {
+        if (remap[index] == unused)
+        {
+            remap[index] = vertexCount++;
+        }
+        index = remap[index];
+    }
+    vector<GLfloat> vertices(6 * vertexCount);
+    for (GLsizei i = 0; i < mesh.vertexCount; ++i)
+    {
+        if (remap[i] != unused)
+        {
+            copy(v + 6 * i, v + 6 * i + 6, vertices.begin() + 6 * remap[i]);
+        }
+    }
+
+    mesh.vertexStorage.swap(vertices);
+    mesh.indexStorage.swap(indices);
+    mesh.file.close();
+    mesh.vertexData = mesh.vertexStorage.data();
+    mesh.vertexCount = vertexCount;
+    mesh.indexData = mesh.indexStorage.data();
+    mesh.indexCount = mesh.indexStorage.size();
+    mesh.lods[0] = { 0, (GLuint) mesh.indexCount, 0 };
+    mesh.lodCount = 1;
+
+    stats.acmrAfter = ComputeACMR(mesh.indexData, mesh.indexCount, mesh.vertexCount);
+    stats.ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+    return stats;
+}
@@ -0,0 +1,38 @@
+#ifndef MESH_OPTIMIZE_H
+#define MESH_OPTIMIZE_H
+
+#include <cstddef>
+#include <GL/glew.h>
+
+struct GpuMesh;
+
+/// Entries of the post-transform vertex cache the optimizer plans for and
+/// ComputeACMR simulates (FIFO, as on most hardware)
+const int kVertexCacheSize = 16;
+
+/// Average cache miss ratio: vertex shader invocations per triangle when
+/// indices are drawn in order through a kVertexCacheSize entry FIFO.
+/// 3 is the worst case, about 0.5 the best a large mesh can get.
+double ComputeACMR(const GLuint* indices, size_t indexCount, size_t vertexCount);
+
+/// Tipsify alone: reorders the triangles of an index list for the vertex cache
+void OptimizeTriangleOrder(GLuint* indices, size_t indexCount, size_t vertexCount);
+
+/// What OptimizeGpuMesh did to a mesh
+struct MeshOptimizeStats
+{
+    double acmrBefore = 0;
+    double acmrAfter = 0;
+    int clusters = 0;   // runs of triangles ordered for overdraw
+    double ms = 0;
+};
+
+/// Reorders the triangles of mesh for vertex cache reuse with Tipsify
+/// (Sander, Nehab and Barczak 2007), sorts the resulting clusters so that
+/// outward-facing, outlying ones are drawn first (less overdraw), then
+/// renumbers the vertices in order of first use so vertex fetches walk
+/// the buffer forwards. Moves the mesh into its own storage. Works on
+/// meshes with a single level, i.e. before BuildLodChain.
+MeshOptimizeStats OptimizeGpuMesh(GpuMesh& mesh);
+
+#endif
@@ -0,0 +1,495 @@
+#include "mesh_simplify.h"
+
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <functional>
+#include <queue>
+#include <unordered_map>
+#include <vector>
+#include "mesh_cache.h"
+#include "mesh_optimize.h"
+
+using namespace std;
+
+namespace
+{
+
+/// Open edges get a plane perpendicular to their triangle with this weight,
+/// so the outline of an open mesh is kept
+const double kBoundaryWeight = 10;
+
+/// Weight of the normal deviation of a collapse, which is added to its
+/// quadric error scaled by the squared edge length: moving a vertex across
+/// a 90 degree crease costs about as much as moving it off the surface by
+/// the length of the edge
+const double kNormalWeight = 1;
+
+/// A corner on a normal seam keeps its side of the seam: it moves to the
+/// vertex at the new position whose normal is at least this close (cosine),
+/// or else to a copy of that vertex carrying the corner's own normal
+const double kSeamCos = 0.9;
+
+/// Symmetric 4x4 matrix whose v^T Q v is the sum of the squared distances
+/// of v from a set of planes; upper triangle, row by row
+struct Quadric
+{
+    double a[10] = {0};
+
+    void addPlane(double nx, double ny, double nz, double d, double weight)
+    {
+        double p[4] = { nx, ny, nz, d };
+        int k = 0;
+        for (int i = 0; i < 4; ++i)
+        {
+            for (int j = i; j < 4; ++j)
+            {
+                a[k++] += weight * p[i] * p[j];
+            }
+        }
+    }
+
+    void add(const Quadric& other)
+    {
+        for (int k = 0; k < 10; ++k) a[k] += other.a[k];
+    }
+
+    double evaluate(const GLfloat* v) const
+    {
+        double x = v[0], y = v[1], z = v[2];
+        return a[0] * x * x + 2 * a[1] * x * y + 2 * a[2] * x * z + 2 * a[3] * x +
+               a[4] * y * y + 2 * a[5] * y * z + 2 * a[6] * y +
+               a[7] * z * z + 2 * a[8] * z + a[9];
+    }
+};
+
+/// Moving vertex from onto vertex to; stale once either vertex changed
+struct Collapse
+{
+    double cost;
+    GLuint from, to;
+    unsigned fromStamp, toStamp;
+
+    bool operator>(const Collapse& other) const { return cost > other.cost; }
+};
+
+inline void cross(const double a[3], const double b[3], double out[3])
+{
+    out[0] = a[1] * b[2] - a[2] * b[1];
+    out[1] = a[2] * b[0] - a[0] * b[2];
+    out[2] = a[0] * b[1] - a[1] * b[0];
+}
+
+inline double dot(const double a[3], const double b[3])
+{
+    return a[0] * b[0] + a[1] * b[1] + a[2] * b[2];
+}
+
+/// Unnormalized normal of the triangle p0 p1 p2
+inline void triangleNormal(const GLfloat* p0, const GLfloat* p1, const GLfloat* p2, double n[3])
+{
+    double e1[3] = { (double) p1[0] - p0[0], (double) p1[1] - p0[1], (double) p1[2] - p0[2] };
+    double e2[3] = { (double) p2[0] - p0[0], (double) p2[1] - p0[1], (double) p2[2] - p0[2] };
+    cross(e1, e2, n);
+}
+
+class Simplifier
+{
+public:
+    explicit Simplifier(const GpuMesh& mesh);
+
+    /// Collapses edges until at most targetTriangles are left or no collapse is allowed
+    void simplify(size_t targetTriangles);
+
+    size_t triangleCount() const { return liveTriangles; }
+    /// Largest quadric error of a collapse so far, as a distance
+    double error() const { return sqrt(maxCost); }
+    /// The remaining triangles, in mesh vertex indices; those from
+    /// vertexCount on are copiedVertices()
+    void indices(vector<GLuint>& out) const;
+    /// Vertices made for corners on seams, 6 floats each like the mesh's
+    const vector<GLfloat>& copiedVertices() const { return copies; }
+
+private:
+    const GLfloat* vertex(GLuint v) const { return v < vertexCount ? vertexData + 6 * v : copies.data() + 6 * (v - vertexCount); }
+    const GLfloat* position(GLuint v) const { return vertex(v); }
+    const GLfloat* normal(GLuint v) const { return vertex(v) + 3; }
+    double normalDeviation(GLuint from, GLuint to) const;
+    GLuint cornerVertex(GLuint corner, GLuint from, GLuint to);
+    void pushCollapse(GLuint from, GLuint to);
+    void pushEdges(GLuint v);
+    bool canCollapse(GLuint from, GLuint to);
+    void collapse(GLuint from, GLuint to);
+
+    const GLfloat* vertexData;
+    GLuint vertexCount;
+    // triangles and everything per vertex below use welded vertices, the
+    // first of the mesh vertices at each position; corners holds the mesh
+    // vertex each corner is drawn with
+    vector<array<GLuint, 3>> triangles;
+    vector<array<GLuint, 3>> corners;
+    vector<vector<GLuint>> positionVertices; // per welded vertex: the mesh vertices and copies at its position
+    vector<GLfloat> copies;
+    vector<GLuint> copySources;              // mesh vertex whose normal each copy carries
+    unordered_map<uint64_t, GLuint> copyIndex;
+    vector<char> triangleAlive;
+    size_t liveTriangles = 0;
+    vector<vector<unsigned>> vertexTriangles;
+    vector<Quadric> quadrics;
+    vector<char> vertexAlive;
+    vector<unsigned> stamps;
+    vector<unsigned> marks; // canCollapse and pushEdges scratch
+    unsigned markStamp = 0;
+    priority_queue<Collapse, vector<Collapse>, greater<Collapse>> heap;
+    double maxCost = 0;
+};
+
+Simplifier::Simplifier(const GpuMesh& mesh)
+    : vertexData(mesh.vertexData),
+      vertexCount(mesh.vertexCount),
+      positionVertices(mesh.vertexCount),
+      vertexTriangles(mesh.vertexCount),
+      quadrics(mesh.vertexCount),
+      vertexAlive(mesh.vertexCount, 1),
+      stamps(mesh.vertexCount, 0),
+      marks(mesh.vertexCount, 0)
+{
+    // vertices split only by their normal collapse as one
+    struct PositionHash
+    {
+        size_t operator()(const array<uint32_t, 3>& p) const { return p[0] * 73856093u ^ p[1] * 19349663u ^ p[2] * 83492791u; }
+    };
+    unordered_map<array<uint32_t, 3>, GLuint, PositionHash> welded;
+    vector<GLuint> canonical(mesh.vertexCount);
+    for (GLsizei v = 0; v < mesh.vertexCount; ++v)
+    {
+        array<uint32_t, 3> key;
+        memcpy(key.data(), position(v), sizeof(key));
+        canonical[v] = welded.emplace(key, v).first->second;
+        positionVertices[canonical[v]].push_back(v);
+    }
+
+    const MeshLod& base = mesh.lods[0];
+    for (GLuint k = 0; k + 2 < base.indexCount; k += 3)
+    {
+        const GLuint* t = mesh.indexData + base.firstIndex + k;
+        // the tables are per vertex; a bad index would write past them
+        if (!IndicesInRange(t, 3, mesh.vertexCount))
+        {
+            continue;
+        }
+        array<GLuint, 3> triangle = { canonical[t[0]], canonical[t[1]], canonical[t[2]] };
+        if (triangle[0] == triangle[1] || triangle[1] == triangle[2] || triangle[0] == triangle[2])
+        {
+            continue;
+        }
+        for (GLuint v : triangle)
+        {
+            vertexTriangles[v].push_back(triangles.size());
+        }
+        triangles.push_back(triangle);
+        corners.push_back({ t[0], t[1], t[2] });
+    }
+    triangleAlive.assign(triangles.size(), 1);
+    liveTriangles = triangles.size();
+
+    unordered_map<uint64_t, int> edgeUses;
+    for (const auto& t : triangles)
+    {
+        double n[3];
+        triangleNormal(position(t[0]), position(t[1]), position(t[2]), n);
+        double length = sqrt(dot(n, n));
+        if (length == 0) continue;
+        for (double& c : n) c /= length;
+        double d = -(n[0] * position(t[0])[0] + n[1] * position(t[0])[1] + n[2] * position(t[0])[2]);
+        for (int c = 0; c < 3; ++c)
+        {
+            quadrics[t[c]].addPlane(n[0], n[1], n[2], d, 1);
+            GLuint a = t[c], b = t[(c + 1) % 3];
+            ++edgeUses[(uint64_t) min(a, b) << 32 | max(a, b)];
+        }
+    }
+
+    for (const auto& t : triangles)
+    {
+        double n[3];
+        triangleNormal(position(t[0]), position(t[1]), position(t[2]), n);
+        for (int c = 0; c < 3; ++c)
+        {
+            GLuint a = t[c], b = t[(c + 1) % 3];
+            if (edgeUses[(uint64_t) min(a, b) << 32 | max(a, b)] != 1) continue;
+
+            const GLfloat* pa = position(a);
+            const GLfloat* pb = position(b);
+            double edge[3] = { (double) pb[0] - pa[0], (double) pb[1] - pa[1], (double) pb[2] - pa[2] };
+            double side[3];
+            cross(edge, n, side);
+            double length = sqrt(dot(side, side));
+            if (length == 0) continue;
+            for (double& s : side) s /= length;
+            double d = -(side[0] * pa[0] + side[1] * pa[1] + side[2] * pa[2]);
+            quadrics[a].addPlane(side[0], side[1], side[2], d, kBoundaryWeight);
+            quadrics[b].addPlane(side[0], side[1], side[2], d, kBoundaryWeight);
+        }
+    }
+
+    for (const auto& t : triangles)
+    {
+        for (int c = 0; c < 3; ++c)
+        {
+            pushCollapse(t[c], t[(c + 1) % 3]);
+            pushCollapse(t[(c + 1) % 3], t[c]);
+        }
+    }
+}
+
+/// 1 - the cosine between a normal at from and the closest one at to, for
+/// the worst of the normals at from: 0 on a smooth flat patch, about 1
+/// for a collapse across a 90 degree crease
+double Simplifier::normalDeviation(GLuint from, GLuint to) const
+{
+    double deviation = 0;
+    for (GLuint u : positionVertices[from])
+    {
+        double closest = -1;
+        for (GLuint w : positionVertices[to])
+        {
+            const GLfloat* a = normal(u);
+            const GLfloat* b = normal(w);
+            closest = max(closest, (double) a[0] * b[0] + (double) a[1] * b[1] + (double) a[2] * b[2]);
+        }
+        deviation = max(deviation, 1 - closest);
+    }
+    return deviation;
+}
+
+/// The vertex a corner drawn with vertex corner is drawn with once its
+/// welded vertex from moved onto to
+GLuint Simplifier::cornerVertex(GLuint corner, GLuint from, GLuint to)
+{
+    const vector<GLuint>& candidates = positionVertices[to];
+    GLuint best = candidates[0];
+    double bestCos = -2;
+    const GLfloat* n = normal(corner);
+    for (GLuint w : candidates)
+    {
+        const GLfloat* m = normal(w);
+        double c = (double) n[0] * m[0] + (double) n[1] * m[1] + (double) n[2] * m[2];
+        if (c > bestCos)
+        {
+            best = w;
+            bestCos = c;
+        }
+    }
+
+    // off a seam the normals are interpolated anyway
+    bool onSeam = positionVertices[from].size() > 1;
+    if (bestCos >= kSeamCos || !onSeam)
+    {
+        return best;
+    }
+
+    GLuint source = corner < vertexCount ? corner : copySources[corner - vertexCount];
+    auto found = copyIndex.emplace((uint64_t) to << 32 | source, vertexCount + copySources.size());
+    if (found.second)
+    {
+        copies.insert(copies.end(), position(to), position(to) + 3);
+        copies.insert(copies.end(), normal(source), normal(source) + 3);
+        copySources.push_back(source);
+        positionVertices[to].push_back(found.first->second);
+    }
+    return found.first->second;
+}
+
+void Simplifier::pushCollapse(GLuint from, GLuint to)
+{
+    const GLfloat* p = position(to);
+    const GLfloat* q = position(from);
+    double edge[3] = { (double) p[0] - q[0], (double) p[1] - q[1], (double) p[2] - q[2] };
+    double cost = quadrics[from].evaluate(p) + quadrics[to].evaluate(p) +
+                  kNormalWeight * dot(edge, edge) * normalDeviation(from, to);
+    heap.push({ max(cost, 0.0), from, to, stamps[from], stamps[to] });
+}
+
+void Simplifier::pushEdges(GLuint v)
+{
+    ++markStamp;
+    for (unsigned t : vertexTriangles[v])
+    {
+        for (GLuint w : triangles[t])
+        {
+            // most neighbours are on two of the triangles
+            if (w == v || marks[w] == markStamp) continue;
+            marks[w] = markStamp;
+            pushCollapse(v, w);
+            pushCollapse(w, v);
+        }
+    }
+}
+
+bool Simplifier::canCollapse(GLuint from, GLuint to)
+{
+    // link condition: the only neighbours the two share are the tips of the
+    // triangles on their edge, otherwise the collapse pinches the surface
+    ++markStamp;
+    int sharedTriangles = 0;
+    for (unsigned t : vertexTriangles[from])
+    {
+        if (!triangleAlive[t]) continue;
+        bool hasTo = false;
+        for (GLuint w : triangles[t])
+        {
+            marks[w] = markStamp;
+            hasTo = hasTo || w == to;
+        }
+        sharedTriangles += hasTo;
+    }
+    ++markStamp;
+    int sharedNeighbours = 0;
+    for (unsigned t : vertexTriangles[to])
+    {
+        if (!triangleAlive[t]) continue;
+        for (GLuint w : triangles[t])
+        {
+            // marked by the pass over from, and not counted yet
+            if (w != from && w != to && marks[w] == markStamp - 1)
+            {
+                marks[w] = markStamp;
+                ++sharedNeighbours;
+            }
+        }
+    }
+    if (sharedNeighbours > sharedTriangles)
+    {
+        return false;
+    }
+
+    // no triangle that stays may turn over
+    for (unsigned t : vertexTriangles[from])
+    {
+        if (!triangleAlive[t]) continue;
+        const auto& tri = triangles[t];
+        if (tri[0] == to || tri[1] == to || tri[2] == to) continue;
+
+        const GLfloat* p[3];
+        for (int c = 0; c < 3; ++c) p[c] = position(tri[c]);
+        double before[3], after[3];
+        triangleNormal(p[0], p[1], p[2], before);
+        for (int c = 0; c < 3; ++c)
+        {
+            if (tri[c] == from) p[c] = position(to);
+        }
+        triangleNormal(p[0], p[1], p[2], after);
+        if (dot(before, after) <= 0)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+void Simplifier::collapse(GLuint from, GLuint to)
+{
+    for (unsigned t : vertexTriangles[from])
+    {
+        if (!triangleAlive[t]) continue;
+        auto& tri = triangles[t];
+        if (tri[0] == to || tri[1] == to || tri[2] == to)
+        {
+            triangleAlive[t] = 0;
+            --liveTriangles;
+            continue;
+        }
+        for (int c = 0; c < 3; ++c)
+        {
+            if (tri[c] != from) continue;
+            tri[c] = to;
+            corners[t][c] = cornerVertex(corners[t][c], from, to);
+        }
+        vertexTriangles[to].push_back(t);
+    }
+    vertexTriangles[from].clear();
+    vertexTriangles[from].shrink_to_fit();
+    vertexAlive[from] = 0;
+
+    auto& list = vertexTriangles[to];
+    list.erase(remove_if(list.begin(), list.end(), [&](unsigned t) { return !triangleAlive[t]; }), list.end());
+
+    quadrics[to].add(quadrics[from]);
+    ++stamps[from];
+    ++stamps[to];
+    pushEdges(to);
+}
+
+void Simplifier::simplify(size_t targetTriangles)
+{
+    while (liveTriangles > targetTriangles && !heap.empty())
+    {
+        Collapse c = heap.top();
+        heap.pop();
+        if (!vertexAlive[c.from] || !vertexAlive[c.to] ||
+            c.fromStamp != stamps[c.from] || c.toStamp != stamps[c.to])
+        {
+            continue; // superseded by a later push
+        }
+        if (!canCollapse(c.from, c.to))
+        {
+            continue;
+        }
+        collapse(c.from, c.to);
+        maxCost = max(maxCost, c.cost);
+    }
+}
+
+void Simplifier::indices(vector<GLuint>& out) const
+{
+    out.clear();
+    for (size_t t = 0; t < triangles.size(); ++t)
+    {
+        if (triangleAlive[t])
+        {
+            out.insert(out.end(), corners[t].begin(), corners[t].end());
+        }
+    }
+}
+
+} // namespace
+
+double BuildLodChain(GpuMesh& mesh)
+{
+    auto start = chrono::steady_clock::now();
+    assert(mesh.lodCount == 1 && mesh.indexData == mesh.indexStorage.data() && mesh.vertexData == mesh.vertexStorage.data());
+
+    Simplifier simplifier(mesh);
+    size_t baseTriangles = mesh.lods[0].indexCount / 3;
+    vector<GLuint> level;
+    for (float ratio : kLodTriangleRatios)
+    {
+        if (mesh.lodCount == kMaxLods) break;
+
+        simplifier.simplify((size_t) (baseTriangles * ratio));
+        simplifier.indices(level);
+        // when nothing more may collapse, another level would be no coarser
+        if (level.empty() || level.size() >= mesh.lods[mesh.lodCount - 1].indexCount) break;
+
+        OptimizeTriangleOrder(level.data(), level.size(), mesh.vertexCount + simplifier.copiedVertices().size() / 6);
+        MeshLod& lod = mesh.lods[mesh.lodCount++];
+        lod.firstIndex = mesh.indexStorage.size();
+        lod.indexCount = level.size();
+        lod.error = simplifier.error();
+        mesh.indexStorage.insert(mesh.indexStorage.end(), level.begin(), level.end());
+    }
+    mesh.indexData = mesh.indexStorage.data();
+    mesh.indexCount = mesh.indexStorage.size();
+
+    // the copies come after the vertices of level 0, which stay where they are
+    const vector<GLfloat>& copies = simplifier.copiedVertices();
+    mesh.vertexStorage.insert(mesh.vertexStorage.end(), copies.begin(), copies.end());
+    mesh.vertexData = mesh.vertexStorage.data();
+    mesh.vertexCount = mesh.vertexStorage.size() / 6;
+
+    return chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+}
@@ -0,0 +1,24 @@
+#ifndef MESH_SIMPLIFY_H
+#define MESH_SIMPLIFY_H
+
+struct GpuMesh;
+
+/// Triangle counts of the levels BuildLodChain adds, as fractions of level 0
+const float kLodTriangleRatios[] = { 0.5f, 0.25f, 0.1f };
+
+/// Simplifies level 0 of mesh by collapsing edges in order of quadric error
+/// (Garland and Heckbert 1997) and appends a level whenever the triangle
+/// count reaches the next of kLodTriangleRatios. Collapses move a vertex
+/// onto a neighbour instead of to a new position, so every level indexes
+/// the vertices of level 0, plus a few copies appended for seams. Vertices
+/// at the same position (normal seams) collapse together, but each corner
+/// keeps its side of the seam: it takes the vertex at the new position with
+/// a matching normal, or a copy carrying its own. The cost of a collapse
+/// includes how far the normals move, so seams are collapsed along rather
+/// than across; collapses that would flip a triangle or pinch the surface
+/// are skipped.
+/// Each level's triangles are reordered for the vertex cache.
+/// Returns the milliseconds it took.
+double BuildLodChain(GpuMesh& mesh);
+
+#endif
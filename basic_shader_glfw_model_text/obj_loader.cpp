@@ -0,0 +1,346 @@
+#include "obj_loader.h"
+#include "file_util.h"
+#include "profile.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cstdio>
+#include <charconv>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+namespace
+{
+
+/// Number of records of each kind, used to size the arrays up front
+struct ObjCounts
+{
+    size_t vertices = 0, textures = 0, normals = 0, faces = 0;
+};
+
+inline const char* lineEnd(const char* p, const char* end)
+{
+    const char* nl = (const char*) memchr(p, '\n', end - p);
+    return nl ? nl : end;
+}
+
+inline const char* skipSpaces(const char* p, const char* end)
+{
+    while (p < end && (*p == ' ' || *p == '\t'))
+    {
+        ++p;
+    }
+    return p;
+}
+
+template <typename T>
+inline const char* parseNumber(const char* p, const char* end, T& out)
+{
+    p = skipSpaces(p, end);
+    if (p < end && *p == '+') // from_chars does not accept a leading '+'
+    {
+        ++p;
+    }
+    return from_chars(p, end, out).ptr;
+}
+
+/// Parses "a", "a/b", "a//c" or "a/b/c" starting at p. Missing parts are 0.
+inline const char* parseFaceVertex(const char* p, const char* end, int& v, int& t, int& n)
+{
+    t = n = 0;
+    p = parseNumber(p, end, v);
+    if (p < end && *p == '/')
+    {
+        ++p;
+        if (p < end && *p != '/')
+        {
+            p = from_chars(p, end, t).ptr;
+        }
+        if (p < end && *p == '/')
+        {
+            p = from_chars(p + 1, end, n).ptr;
+        }
+    }
+    return p;
+}
+
+ObjCounts countObj(const char* p, const char* end)
+{
+    ObjCounts counts;
+
+    while (p < end)
+    {
+        const char* eol = lineEnd(p, end);
+        if (eol - p >= 2)
+        {
+            if (p[0] == 'v')
+            {
+                if (p[1] == 't') ++counts.textures;
+                else if (p[1] == 'n') ++counts.normals;
+                else ++counts.vertices;
+            }
+            else if (p[0] == 'f')
+            {
+                ++counts.faces;
+            }
+        }
+        p = (eol < end) ? eol + 1 : end;
+    }
+
+    return counts;
+}
+
+/// Records parsed from one line-aligned slice of the file
+struct ObjChunk
+{
+    vector<Vertex> vertices;
+    vector<Texture> textures;
+    vector<Normal> normals;
+    vector<Face> faces;
+    vector<string> ignored;
+};
+
+void parseObjRange(const char* p, const char* end, ObjChunk& out)
+{
+    PROFILE_SCOPE("parseObjRange");
+    // counting pass so that parsing never reallocates
+    ObjCounts counts = countObj(p, end);
+    out.vertices.reserve(counts.vertices);
+    out.textures.reserve(counts.textures);
+    out.normals.reserve(counts.normals);
+    out.faces.reserve(counts.faces);
+
+    while (p < end)
+    {
+        const char* eol = lineEnd(p, end);
+        const char* lineStop = (eol > p && eol[-1] == '\r') ? eol - 1 : eol;
+
+        if (lineStop - p >= 2)
+        {
+            GLfloat c1 = 0, c2 = 0, c3 = 0;
+
+            if (p[0] == '#') // comment
+            {
+            }
+            else if (p[0] == 'v')
+            {
+                if (p[1] == 't') // texture
+                {
+                    const char* q = parseNumber(p + 2, lineStop, c1);
+                    parseNumber(q, lineStop, c2);
+                    out.textures.emplace_back(c1, c2);
+                }
+                else if (p[1] == 'n') // normal
+                {
+                    const char* q = parseNumber(p + 2, lineStop, c1);
+                    q = parseNumber(q, lineStop, c2);
+                    parseNumber(q, lineStop, c3);
+                    out.normals.emplace_back(c1, c2, c3);
+                }
+                else // vertex
+                {
+                    const char* q = parseNumber(p + 1, lineStop, c1);
+                    q = parseNumber(q, lineStop, c2);
+                    parseNumber(q, lineStop, c3);
+                    out.vertices.emplace_back(c1, c2, c3);
+                }
+            }
+            else if (p[0] == 'f') // face
+            {
+                int vIndex[3], nIndex[3], tIndex[3];
+                const char* q = p + 1;
+                for (int c = 0; c < 3; ++c)
+                {
+                    q = parseFaceVertex(q, lineStop, vIndex[c], tIndex[c], nIndex[c]);
+                }
+
+                assert(vIndex[0] == nIndex[0] &&
+                       vIndex[1] == nIndex[1] &&
+                       vIndex[2] == nIndex[2]); // a limitation for now
+
+                // make indices start from 0
+                for (int c = 0; c < 3; ++c)
+                {
+                    vIndex[c] -= 1;
+                    nIndex[c] -= 1;
+                    tIndex[c] -= 1;
+                }
+
+                out.faces.emplace_back(vIndex, tIndex, nIndex);
+            }
+            else
+            {
+                out.ignored.emplace_back(p, lineStop);
+            }
+        }
+
+        p = (eol < end) ? eol + 1 : end;
+    }
+}
+
+template <typename T>
+void appendInOrder(vector<T>& dst, vector<ObjChunk>& chunks, vector<T> ObjChunk::* member)
+{
+    size_t total = dst.size();
+    for (ObjChunk& chunk : chunks)
+    {
+        total += (chunk.*member).size();
+    }
+
+    if (dst.empty() && chunks.size() == 1)
+    {
+        dst.swap(chunks[0].*member);
+        return;
+    }
+
+    dst.reserve(total);
+    for (ObjChunk& chunk : chunks)
+    {
+        dst.insert(dst.end(), (chunk.*member).begin(), (chunk.*member).end());
+        vector<T>().swap(chunk.*member);
+    }
+}
+
+} // namespace
+
+bool ParseObj(const string& fileName, int numThreads)
+{
+    PROFILE_SCOPE("ParseObj");
+    auto start = chrono::steady_clock::now();
+
+    MappedFile file;
+    if (!file.open(fileName))
+    {
+        return false;
+    }
+
+    const char* begin = file.data;
+    const char* end = file.data + file.size;
+
+    if (numThreads <= 0)
+    {
+        numThreads = max(1u, thread::hardware_concurrency());
+    }
+
+    // don't bother splitting small files; every chunk gets at least 1 MB
+    const size_t minChunkSize = 1 << 20;
+    size_t numChunks = min<size_t>(numThreads, max<size_t>(1, file.size / minChunkSize));
+
+    // chunk k covers [bounds[k], bounds[k+1]); every bound but the last starts a line
+    vector<const char*> bounds(numChunks + 1, end);
+    bounds[0] = begin;
+    for (size_t k = 1; k < numChunks; ++k)
+    {
+        const char* p = max(bounds[k - 1], begin + file.size * k / numChunks);
+        if (p > begin && p[-1] != '\n')
+        {
+            p = lineEnd(p, end);
+            p = (p < end) ? p + 1 : end;
+        }
+        bounds[k] = p;
+    }
+
+    vector<ObjChunk> chunks(numChunks);
+    vector<thread> workers;
+    for (size_t k = 1; k < numChunks; ++k)
+    {
+        workers.emplace_back(parseObjRange, bounds[k], bounds[k + 1], ref(chunks[k]));
+    }
+    parseObjRange(bounds[0], bounds[1], chunks[0]);
+    for (thread& worker : workers)
+    {
+        worker.join();
+    }
+
+    // concatenating in file order gives exactly the serial result
+    for (ObjChunk& chunk : chunks)
+    {
+        for (const string& line : chunk.ignored)
+        {
+            cout << "Ignoring unidentified line in obj file: " << line << endl;
+        }
+    }
+    size_t vertexBase = gVertices.size(), faceBase = gFaces.size();
+    appendInOrder(gVertices, chunks, &ObjChunk::vertices);
+    appendInOrder(gTextures, chunks, &ObjChunk::textures);
+    appendInOrder(gNormals, chunks, &ObjChunk::normals);
+    appendInOrder(gFaces, chunks, &ObjChunk::faces);
+
+    // the chunks don't know the vertex count; a face that indexes past the
+    // vertices (or before the first, as 0 or a negative index does) would
+    // index the mesh arrays out of bounds
+    GLuint vertexCount = gVertices.size();
+    auto kept = remove_if(gFaces.begin() + faceBase, gFaces.end(), [vertexCount](const Face& f) {
+        return f.vIndex[0] >= vertexCount || f.vIndex[1] >= vertexCount || f.vIndex[2] >= vertexCount;
+    });
+    if (kept != gFaces.end())
+    {
+        cout << "Skipping " << gFaces.end() - kept << " faces of " << fileName
+             << " with vertex indices out of range" << endl;
+        gFaces.erase(kept, gFaces.end());
+    }
+
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    cout << "Parsed " << fileName << ": " << gVertices.size() - vertexBase << " vertices, "
+         << gFaces.size() - faceBase << " faces in " << seconds * 1000 << " ms ("
+         << (file.size / (1024.0 * 1024.0)) / max(seconds, 1e-9) << " MB/s, "
+         << numChunks << " thread(s))" << endl;
+
+	assert(gVertices.size() == gNormals.size());
+
+    return true;
+}
+
+void BenchmarkObjLoad(const string& fileName, int maxThreads)
+{
+    if (maxThreads <= 0)
+    {
+        maxThreads = max(1u, thread::hardware_concurrency());
+    }
+
+    vector<Vertex> refVertices;
+    vector<Normal> refNormals;
+    vector<Face> refFaces;
+    double serialSeconds = 0;
+
+    cout << "threads      ms   speedup  identical" << endl;
+    for (int n = 1; n <= maxThreads; ++n)
+    {
+        gVertices.clear(); gTextures.clear(); gNormals.clear(); gFaces.clear();
+
+        auto start = chrono::steady_clock::now();
+        if (!ParseObj(fileName, n))
+        {
+            cout << "Cannot open " << fileName << endl;
+            return;
+        }
+        double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+        bool identical = true;
+        if (n == 1)
+        {
+            serialSeconds = seconds;
+            refVertices = gVertices;
+            refNormals = gNormals;
+            refFaces = gFaces;
+        }
+        else
+        {
+            identical = gVertices.size() == refVertices.size() &&
+                        gNormals.size() == refNormals.size() &&
+                        gFaces.size() == refFaces.size() &&
+                        !memcmp(gVertices.data(), refVertices.data(), gVertices.size() * sizeof(Vertex)) &&
+                        !memcmp(gNormals.data(), refNormals.data(), gNormals.size() * sizeof(Normal)) &&
+                        !memcmp(gFaces.data(), refFaces.data(), gFaces.size() * sizeof(Face));
+        }
+
+        printf("%7d %7.1f %9.2f  %s\n", n, seconds * 1000, serialSeconds / seconds, identical ? "yes" : "NO");
+    }
+
+    gVertices.clear(); gTextures.clear(); gNormals.clear(); gFaces.clear();
+}
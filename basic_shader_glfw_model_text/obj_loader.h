@@ -0,0 +1,18 @@
+#ifndef OBJ_LOADER_H
+#define OBJ_LOADER_H
+
+#include <string>
+#include "mesh.h"
+
+/// Appends the v/vt/vn/f records of an .obj file to gVertices, gTextures,
+/// gNormals and gFaces. Faces are expected in the "f a//a b//b c//c" form.
+/// The file is split into line-aligned chunks parsed by numThreads workers
+/// (0 = one per core) and merged in file order, so the result does not
+/// depend on the thread count. Returns false if the file cannot be opened.
+bool ParseObj(const std::string& fileName, int numThreads = 0);
+
+/// Parses fileName with 1..maxThreads threads and prints load time, speedup
+/// and whether the result matches the single-threaded parse.
+void BenchmarkObjLoad(const std::string& fileName, int maxThreads);
+
+#endif
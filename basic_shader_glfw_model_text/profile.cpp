@@ -0,0 +1,273 @@
+#include "profile.h"
+
+#include <atomic>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include <GL/glew.h>
+
+using namespace std;
+
+bool gProfiling = false;
+
+namespace
+{
+
+const size_t kRingEvents = 1 << 18; // per thread; a power of two
+const int kMaxRings = 64;           // threads beyond this go unrecorded
+const int kGpuSlots = 1024;         // GPU scopes waiting for their queries
+const int kGpuTid = 0;              // the GPU track; threads count from 1
+
+struct ProfileEvent
+{
+    const char* name;
+    uint64_t startNs;
+    uint64_t endNs;
+};
+
+/// Scopes of one thread. Only that thread writes; ProfileWrite reads once
+/// the threads are idle, so publishing head is all the synchronization.
+struct ProfileRing
+{
+    int tid;
+    string threadName;
+    unique_ptr<ProfileEvent[]> events{ new ProfileEvent[kRingEvents] };
+    atomic<uint64_t> head{ 0 }; // events ever recorded
+
+    void push(const char* name, uint64_t startNs, uint64_t endNs)
+    {
+        uint64_t n = head.load(memory_order_relaxed);
+        events[n & (kRingEvents - 1)] = { name, startNs, endNs };
+        head.store(n + 1, memory_order_release);
+    }
+};
+
+uint64_t gEpochNs = 0;
+
+// rings are only added, under the mutex, the first time a thread records
+mutex gRingsMutex;
+vector<unique_ptr<ProfileRing>> gRings;
+atomic<int> gUnrecordedThreads{ 0 };
+thread_local ProfileRing* tRing = nullptr;
+thread_local bool tRingRefused = false;
+
+ProfileRing* threadRing()
+{
+    if (tRing || tRingRefused)
+    {
+        return tRing;
+    }
+    lock_guard<mutex> lock(gRingsMutex);
+    if (gRings.size() >= kMaxRings)
+    {
+        tRingRefused = true;
+        gUnrecordedThreads.fetch_add(1, memory_order_relaxed);
+        return nullptr;
+    }
+    gRings.emplace_back(new ProfileRing());
+    tRing = gRings.back().get();
+    tRing->tid = gRings.size();
+    tRing->threadName = "thread " + to_string(tRing->tid);
+    return tRing;
+}
+
+/// A GPU scope between ProfileGpuBegin and the results of its queries
+struct GpuSlot
+{
+    const char* name;
+    GLuint queries[2]; // timestamps of the start and the end
+    bool ended;
+};
+
+// render thread only
+int gGpuSupported = -1; // -1 until the first GPU scope asks
+int64_t gGpuToCpuNs = 0; // added to a GL timestamp to get steady_clock time
+GpuSlot gGpuSlots[kGpuSlots];
+vector<int> gFreeGpuSlots;
+vector<int> gOpenGpuSlots; // in the order they began
+int gDroppedGpuScopes = 0;
+ProfileRing* gGpuRing = nullptr;
+
+bool gpuSupported()
+{
+    if (gGpuSupported < 0)
+    {
+        gGpuSupported = GLEW_VERSION_3_3 || GLEW_ARB_timer_query;
+        if (gGpuSupported)
+        {
+            // GL timestamps count from some point of the driver's choosing
+            GLint64 gpuNs = 0;
+            glGetInteger64v(GL_TIMESTAMP, &gpuNs);
+            gGpuToCpuNs = (int64_t) ProfileNowNs() - gpuNs;
+
+            for (int s = kGpuSlots - 1; s >= 0; --s)
+            {
+                gFreeGpuSlots.push_back(s);
+            }
+            gGpuRing = new ProfileRing();
+            gGpuRing->tid = kGpuTid;
+            gGpuRing->threadName = "GPU";
+        }
+    }
+    return gGpuSupported;
+}
+
+/// Records the scopes whose results are in; with wait, all of them
+void collectGpu(bool wait)
+{
+    size_t kept = 0;
+    for (size_t n = 0; n < gOpenGpuSlots.size(); ++n)
+    {
+        int s = gOpenGpuSlots[n];
+        GpuSlot& slot = gGpuSlots[s];
+        GLint available = GL_FALSE;
+        if (slot.ended && !wait)
+        {
+            // the end is written after the start, so it's the last to be available
+            glGetQueryObjectiv(slot.queries[1], GL_QUERY_RESULT_AVAILABLE, &available);
+        }
+        if (!slot.ended || (!available && !wait))
+        {
+            gOpenGpuSlots[kept++] = s;
+            continue;
+        }
+
+        GLuint64 startNs = 0, endNs = 0;
+        glGetQueryObjectui64v(slot.queries[0], GL_QUERY_RESULT, &startNs);
+        glGetQueryObjectui64v(slot.queries[1], GL_QUERY_RESULT, &endNs);
+        gGpuRing->push(slot.name, startNs + gGpuToCpuNs, endNs + gGpuToCpuNs);
+        gFreeGpuSlots.push_back(s);
+    }
+    gOpenGpuSlots.resize(kept);
+}
+
+void writeTrack(FILE* f, const ProfileRing& ring, bool& first, size_t& written, uint64_t& overwritten)
+{
+    fprintf(f, "%s\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"%s\"}}",
+            first ? "" : ",", ring.tid, ring.threadName.c_str());
+    first = false;
+
+    uint64_t head = ring.head.load(memory_order_acquire);
+    uint64_t begin = head > kRingEvents ? head - kRingEvents : 0;
+    overwritten += begin;
+    for (uint64_t n = begin; n < head; ++n)
+    {
+        const ProfileEvent& e = ring.events[n & (kRingEvents - 1)];
+        // microseconds since ProfileEnable
+        fprintf(f, ",\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f}", e.name, ring.tid,
+                ((int64_t) (e.startNs - gEpochNs)) / 1e3, (e.endNs - e.startNs) / 1e3);
+        ++written;
+    }
+}
+
+} // namespace
+
+void ProfileEnable()
+{
+    gEpochNs = ProfileNowNs();
+    gProfiling = true;
+}
+
+void ProfileThreadName(const char* name)
+{
+    if (!gProfiling) return;
+
+    ProfileRing* ring = threadRing();
+    if (ring)
+    {
+        lock_guard<mutex> lock(gRingsMutex);
+        ring->threadName = name;
+    }
+}
+
+void ProfileRecord(const char* name, uint64_t startNs, uint64_t endNs)
+{
+    ProfileRing* ring = threadRing();
+    if (ring)
+    {
+        ring->push(name, startNs, endNs);
+    }
+}
+
+int ProfileGpuBegin(const char* name)
+{
+    if (!gpuSupported())
+    {
+        return -1;
+    }
+    if (gFreeGpuSlots.empty())
+    {
+        ++gDroppedGpuScopes; // more than kGpuSlots in flight; ProfileCollectGpu isn't being called
+        return -1;
+    }
+
+    int s = gFreeGpuSlots.back();
+    gFreeGpuSlots.pop_back();
+    GpuSlot& slot = gGpuSlots[s];
+    if (!slot.queries[0])
+    {
+        glGenQueries(2, slot.queries);
+    }
+    slot.name = name;
+    slot.ended = false;
+    glQueryCounter(slot.queries[0], GL_TIMESTAMP);
+    gOpenGpuSlots.push_back(s);
+    return s;
+}
+
+void ProfileGpuEnd(int slot)
+{
+    if (slot < 0) return;
+
+    glQueryCounter(gGpuSlots[slot].queries[1], GL_TIMESTAMP);
+    gGpuSlots[slot].ended = true;
+}
+
+void ProfileCollectGpu()
+{
+    if (gProfiling && gGpuSupported > 0)
+    {
+        collectGpu(false);
+    }
+}
+
+bool ProfileWrite(const string& fileName)
+{
+    if (gGpuSupported > 0)
+    {
+        collectGpu(true);
+    }
+
+    FILE* f = fopen(fileName.c_str(), "w");
+    if (!f)
+    {
+        perror(fileName.c_str());
+        return false;
+    }
+
+    bool first = true;
+    size_t written = 0;
+    uint64_t overwritten = 0;
+    fprintf(f, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[");
+    {
+        lock_guard<mutex> lock(gRingsMutex);
+        for (const auto& ring : gRings)
+        {
+            writeTrack(f, *ring, first, written, overwritten);
+        }
+    }
+    if (gGpuRing)
+    {
+        writeTrack(f, *gGpuRing, first, written, overwritten);
+    }
+    fprintf(f, "\n]}\n");
+    bool ok = fclose(f) == 0;
+
+    printf("Profile: %zu scopes written to %s", written, fileName.c_str());
+    if (overwritten) printf(", %llu older ones overwritten", (unsigned long long) overwritten);
+    if (gDroppedGpuScopes) printf(", %d GPU scopes dropped", gDroppedGpuScopes);
+    if (gUnrecordedThreads) printf(", %d threads not recorded", gUnrecordedThreads.load());
+    printf("\n");
+    return ok;
+}
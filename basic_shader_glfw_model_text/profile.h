@@ -0,0 +1,108 @@
+#ifndef PROFILE_H
+#define PROFILE_H
+
+#include <chrono>
+#include <cstdint>
+#include <string>
+
+/// Whether scopes record; set by ProfileEnable before any thread is started
+/// and never cleared, so it needs no synchronization
+extern bool gProfiling;
+
+/// Turns recording on for the rest of the run
+void ProfileEnable();
+
+/// Names the calling thread's track in the trace
+void ProfileThreadName(const char* name);
+
+inline uint64_t ProfileNowNs()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+/// Appends a finished scope to the calling thread's ring. Each thread has a
+/// ring of its own with a single writer, so this never locks or waits;
+/// when the ring is full the oldest scopes are overwritten.
+void ProfileRecord(const char* name, uint64_t startNs, uint64_t endNs);
+
+/// Render thread: writes a GL timestamp query for the start of a GPU
+/// scope and returns its slot, or -1 without timer queries or free slots
+int ProfileGpuBegin(const char* name);
+void ProfileGpuEnd(int slot);
+
+/// Render thread, between frames: moves the GPU scopes whose queries have
+/// results into the GPU track. Never waits for the GPU.
+void ProfileCollectGpu();
+
+/// Waits for the outstanding GPU scopes and writes everything recorded as
+/// Chrome trace event JSON (about:tracing, ui.perfetto.dev). Call with the
+/// GL context current, if there is one, while the other threads are idle.
+bool ProfileWrite(const std::string& fileName);
+
+/// Records the time from construction to destruction under name, which
+/// must outlive the run (a string literal). Nested scopes nest in the
+/// trace. gProfiling is read once, on entry, into enabled; when it is off
+/// that one test is all the scope costs, and the exit tests the same copy.
+class ProfileScope
+{
+public:
+    explicit ProfileScope(const char* scopeName) : name(scopeName), enabled(gProfiling)
+    {
+        if (enabled) startNs = ProfileNowNs();
+    }
+
+    ~ProfileScope()
+    {
+        if (enabled) ProfileRecord(name, startNs, ProfileNowNs());
+    }
+
+    ProfileScope(const ProfileScope&) = delete;
+    ProfileScope& operator=(const ProfileScope&) = delete;
+
+private:
+    const char* name;
+    const bool enabled;
+    uint64_t startNs = 0;
+};
+
+/// A ProfileScope that also records the GPU time of the GL commands issued
+/// in it, on the GPU track. Render thread only.
+class GpuProfileScope
+{
+public:
+    explicit GpuProfileScope(const char* scopeName) : name(scopeName), enabled(gProfiling)
+    {
+        if (enabled)
+        {
+            startNs = ProfileNowNs();
+            gpuSlot = ProfileGpuBegin(scopeName);
+        }
+    }
+
+    ~GpuProfileScope()
+    {
+        if (enabled)
+        {
+            ProfileGpuEnd(gpuSlot);
+            ProfileRecord(name, startNs, ProfileNowNs());
+        }
+    }
+
+    GpuProfileScope(const GpuProfileScope&) = delete;
+    GpuProfileScope& operator=(const GpuProfileScope&) = delete;
+
+private:
+    const char* name;
+    const bool enabled;
+    uint64_t startNs = 0;
+    int gpuSlot = -1;
+};
+
+#define PROFILE_CONCAT_(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_(a, b)
+
+/// Profiles the rest of the enclosing block
+#define PROFILE_SCOPE(name) ProfileScope PROFILE_CONCAT(profileScope, __LINE__)(name)
+#define PROFILE_GPU_SCOPE(name) GpuProfileScope PROFILE_CONCAT(profileScope, __LINE__)(name)
+
+#endif
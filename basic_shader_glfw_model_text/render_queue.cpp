@@ -0,0 +1,18 @@
+#include "render_queue.h"
+
+#include <algorithm>
+
+void RenderQueue::sort()
+{
+    std::sort(order.begin(), order.end());
+}
+
+size_t RenderQueue::runLength(size_t begin) const
+{
+    size_t end = begin;
+    while (end < order.size() && (order[end].key >> 32) == (order[begin].key >> 32))
+    {
+        ++end;
+    }
+    return end - begin;
+}
@@ -0,0 +1,56 @@
+#ifndef RENDER_QUEUE_H
+#define RENDER_QUEUE_H
+
+#include <cstdint>
+#include <vector>
+#include <glm/glm.hpp>
+
+/// Sort key of one queued draw: material (gProgram slot) in the high bits,
+/// then the level of detail, so that draws sharing a program and an index
+/// range end up next to each other, then the order in which the cell was
+/// queued to keep the sort deterministic. The material is 0 in queues that
+/// don't sort by it.
+struct DrawKey
+{
+    uint64_t key;
+    uint32_t index; // into RenderQueue::matrices
+
+    int material() const { return (int) (key >> 40); }
+    int lod() const { return (int) (key >> 32) & 0xff; }
+    bool operator<(const DrawKey& other) const { return key < other.key; }
+};
+
+/// The enabled cells of one frame, collected before any draw call is made
+struct RenderQueue
+{
+    std::vector<glm::mat4> matrices; // model matrix per queued cell, in queue order
+    std::vector<uint8_t> materials;  // material per queued cell, in queue order
+    std::vector<DrawKey> order;      // draw order, sorted by sort()
+    // false when one program draws every material (the uber shader), so
+    // runs only need to share the level of detail
+    bool sortByMaterial = true;
+
+    void clear()
+    {
+        matrices.clear();
+        materials.clear();
+        order.clear();
+    }
+
+    void add(int material, const glm::mat4& modelMat, int lod = 0)
+    {
+        uint32_t index = matrices.size();
+        uint64_t keyMaterial = sortByMaterial ? material : 0;
+        order.push_back({ (keyMaterial << 40) | ((uint64_t) lod << 32) | index, index });
+        matrices.push_back(modelMat);
+        materials.push_back(material);
+    }
+
+    /// Groups the draws by material (if sortByMaterial) and level of detail
+    void sort();
+
+    /// Number of draws in order[begin..] that share order[begin]'s key material and level
+    size_t runLength(size_t begin) const;
+};
+
+#endif
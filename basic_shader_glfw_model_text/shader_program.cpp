@@ -0,0 +1,346 @@
+#include "shader_program.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include "file_util.h"
+
+using namespace std;
+
+ProgramBuildStats gProgramBuildStats;
+
+namespace
+{
+
+const uint32_t kProgramCacheVersion = 1;
+
+/// On-disk layout: header, then what glGetProgramBinary returned
+struct ProgramCacheHeader
+{
+    char magic[4];
+    uint32_t version;
+    uint64_t sourceHash;
+    uint32_t binaryFormat;
+    uint32_t binaryLength;
+};
+
+/// What the driver offers; -1 until the first build asks
+int gBinariesSupported = -1;
+int gParallelCompile = -1;
+
+bool binariesSupported()
+{
+    if (gBinariesSupported < 0)
+    {
+        GLint formats = 0;
+        if (GLEW_ARB_get_program_binary)
+        {
+            glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+        }
+        gBinariesSupported = formats > 0;
+    }
+    return gBinariesSupported;
+}
+
+bool parallelCompile()
+{
+    if (gParallelCompile < 0)
+    {
+        gParallelCompile = GLEW_KHR_parallel_shader_compile;
+        if (gParallelCompile)
+        {
+            // as many as the driver likes
+            glMaxShaderCompilerThreadsKHR(0xffffffff);
+        }
+    }
+    return gParallelCompile;
+}
+
+/// Reads fileName and inserts defines and includes right after its #version line
+bool readStage(const string& fileName, const string& defines, const vector<string>& includes, string& text)
+{
+    string prelude = defines;
+    for (const string& include : includes)
+    {
+        if (!ReadDataFromFile(include, prelude))
+        {
+            printf("Cannot find file name: %s\n", include.c_str());
+            return false;
+        }
+        prelude += "\n";
+    }
+
+    text.clear();
+    if (!ReadDataFromFile(fileName, text))
+    {
+        printf("Cannot find file name: %s\n", fileName.c_str());
+        return false;
+    }
+    if (!prelude.empty())
+    {
+        size_t firstLine = text.find('\n') + 1;
+        // keep the line numbers of compile errors those of the file
+        text.insert(firstLine, prelude + "#line 2\n");
+    }
+    return true;
+}
+
+GLuint startCompile(GLenum type, const string& text)
+{
+    GLint length = text.length();
+    const GLchar* source = (const GLchar*) text.c_str();
+
+    GLuint shader = glCreateShader(type);
+    glShaderSource(shader, 1, &source, &length);
+    glCompileShader(shader);
+    return shader;
+}
+
+/// Prints the log of shader if there is one; returns whether it compiled
+bool checkCompile(GLuint shader, const string& fileName, const char* stage)
+{
+    GLint compiled = GL_FALSE;
+    glGetShaderiv(shader, GL_COMPILE_STATUS, &compiled);
+    char output[1024] = {0};
+    glGetShaderInfoLog(shader, sizeof(output), NULL, output);
+    if (!compiled || output[0])
+    {
+        printf("%s compile log of %s: %s\n", stage, fileName.c_str(), output);
+    }
+    return compiled;
+}
+
+bool isLinked(GLuint program)
+{
+    GLint linked = GL_FALSE;
+    glGetProgramiv(program, GL_LINK_STATUS, &linked);
+    return linked;
+}
+
+uint64_t sourceHash(const ProgramSource& source, const ProgramText& text)
+{
+    uint64_t hash = HashBytes(nullptr, 0);
+    for (const string* stage : { &text.vertex, &text.fragment })
+    {
+        size_t size = stage->size();
+        hash = HashBytes(&size, sizeof(size), hash);
+        hash = HashBytes(stage->data(), size, hash);
+    }
+    for (const auto& attrib : source.attribLocations)
+    {
+        hash = HashBytes(attrib.first.c_str(), attrib.first.size() + 1, hash);
+        hash = HashBytes(&attrib.second, sizeof(attrib.second), hash);
+    }
+    // a binary is only good for the driver that made it
+    for (GLenum name : { GL_VENDOR, GL_RENDERER, GL_VERSION })
+    {
+        const char* s = (const char*) glGetString(name);
+        hash = HashBytes(s ? s : "", s ? strlen(s) + 1 : 1, hash);
+    }
+    return hash;
+}
+
+string programCachePath(uint64_t hash)
+{
+    return CacheFilePath("program", hash, ".bin");
+}
+
+/// Result of looking a program up in the cache
+enum CacheLookup { kCacheMiss, kCacheLoaded, kCacheRejected };
+
+CacheLookup loadProgramBinary(GLuint program, uint64_t hash)
+{
+    MappedFile file;
+    if (!file.open(programCachePath(hash)) || file.size < sizeof(ProgramCacheHeader))
+    {
+        return kCacheMiss;
+    }
+
+    ProgramCacheHeader header;
+    memcpy(&header, file.data, sizeof(header));
+    bool valid = memcmp(header.magic, "HW3P", 4) == 0 &&
+                 header.version == kProgramCacheVersion &&
+                 header.sourceHash == hash &&
+                 file.size == sizeof(header) + header.binaryLength;
+    if (!valid)
+    {
+        return kCacheMiss;
+    }
+
+    // a driver update may refuse an old binary even with the same version string
+    glProgramBinary(program, header.binaryFormat, file.data + sizeof(header), header.binaryLength);
+    return isLinked(program) ? kCacheLoaded : kCacheRejected;
+}
+
+bool saveProgramBinary(GLuint program, uint64_t hash)
+{
+    GLint length = 0;
+    glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+    if (length <= 0)
+    {
+        return false;
+    }
+
+    vector<char> binary(length);
+    GLenum format = 0;
+    glGetProgramBinary(program, length, &length, &format, binary.data());
+    if (length <= 0)
+    {
+        return false;
+    }
+
+    ProgramCacheHeader header = {};
+    memcpy(header.magic, "HW3P", 4);
+    header.version = kProgramCacheVersion;
+    header.sourceHash = hash;
+    header.binaryFormat = format;
+    header.binaryLength = length;
+
+    const void* parts[] = { &header, binary.data() };
+    size_t sizes[] = { sizeof(header), (size_t) length };
+    return WriteFileAtomic(programCachePath(hash), parts, sizes, 2);
+}
+
+} // namespace
+
+vector<string> ProgramSource::files() const
+{
+    vector<string> all = vertexIncludes;
+    all.insert(all.end(), fragmentIncludes.begin(), fragmentIncludes.end());
+    all.push_back(vertexFile);
+    all.push_back(fragmentFile);
+    return all;
+}
+
+bool ReadDataFromFile(const string& fileName, string& data)
+{
+    MappedFile file;
+    if (!file.open(fileName))
+    {
+        return false;
+    }
+    data.append(file.data ? file.data : "", file.size);
+    return true;
+}
+
+bool ReadProgramText(const ProgramSource& source, ProgramText& text)
+{
+    return readStage(source.vertexFile, source.vertexDefines, source.vertexIncludes, text.vertex) &&
+           readStage(source.fragmentFile, "", source.fragmentIncludes, text.fragment);
+}
+
+void BeginProgramBuild(const ProgramSource& source, const ProgramText& text, ProgramBuild& build)
+{
+    build = ProgramBuild();
+    build.program = glCreateProgram();
+    if (gCacheEnabled && binariesSupported())
+    {
+        build.hash = sourceHash(source, text);
+        CacheLookup lookup = loadProgramBinary(build.program, build.hash);
+        if (lookup == kCacheLoaded)
+        {
+            build.fromCache = true;
+            ++gProgramBuildStats.fromCache;
+            return;
+        }
+        if (lookup == kCacheRejected)
+        {
+            // start over with a program that has no failed link behind it
+            ++gProgramBuildStats.cacheRejected;
+            glDeleteProgram(build.program);
+            build.program = glCreateProgram();
+        }
+    }
+
+    parallelCompile();
+    build.vertexShader = startCompile(GL_VERTEX_SHADER, text.vertex);
+    build.fragmentShader = startCompile(GL_FRAGMENT_SHADER, text.fragment);
+    glAttachShader(build.program, build.vertexShader);
+    glAttachShader(build.program, build.fragmentShader);
+    for (const auto& attrib : source.attribLocations)
+    {
+        glBindAttribLocation(build.program, attrib.second, attrib.first.c_str());
+    }
+    if (build.hash)
+    {
+        glProgramParameteri(build.program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+    }
+    // fails if a stage did not compile, which FinishProgramBuild reports
+    glLinkProgram(build.program);
+}
+
+bool IsProgramBuildDone(const ProgramBuild& build)
+{
+    if (build.fromCache || !parallelCompile())
+    {
+        return true;
+    }
+    GLint done = GL_FALSE;
+    glGetProgramiv(build.program, GL_COMPLETION_STATUS_KHR, &done);
+    return done;
+}
+
+GLuint FinishProgramBuild(const ProgramSource& source, ProgramBuild& build)
+{
+    GLuint program = build.program;
+    if (build.fromCache)
+    {
+        build = ProgramBuild();
+        return program;
+    }
+
+    bool compiled = checkCompile(build.vertexShader, source.vertexFile, "VS");
+    compiled = checkCompile(build.fragmentShader, source.fragmentFile, "FS") && compiled;
+
+    // the program keeps what it needs
+    glDetachShader(program, build.vertexShader);
+    glDetachShader(program, build.fragmentShader);
+    glDeleteShader(build.vertexShader);
+    glDeleteShader(build.fragmentShader);
+
+    if (!compiled || !isLinked(program))
+    {
+        if (compiled)
+        {
+            char output[1024] = {0};
+            glGetProgramInfoLog(program, sizeof(output), NULL, output);
+            printf("Program of %s and %s does not link: %s\n", source.vertexFile.c_str(), source.fragmentFile.c_str(), output);
+        }
+        glDeleteProgram(program);
+        build = ProgramBuild();
+        return 0;
+    }
+
+    ++gProgramBuildStats.compiled;
+    if (build.hash)
+    {
+        saveProgramBinary(program, build.hash);
+    }
+    build = ProgramBuild();
+    return program;
+}
+
+void CancelProgramBuild(ProgramBuild& build)
+{
+    glDeleteShader(build.vertexShader);
+    glDeleteShader(build.fragmentShader);
+    glDeleteProgram(build.program);
+    build = ProgramBuild();
+}
+
+GLuint BuildProgram(const ProgramSource& source)
+{
+    auto start = chrono::steady_clock::now();
+
+    GLuint program = 0;
+    ProgramText text;
+    if (ReadProgramText(source, text))
+    {
+        ProgramBuild build;
+        BeginProgramBuild(source, text, build);
+        program = FinishProgramBuild(source, build);
+    }
+
+    gProgramBuildStats.ms += chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+    return program;
+}
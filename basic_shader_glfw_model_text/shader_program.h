@@ -0,0 +1,83 @@
+#ifndef SHADER_PROGRAM_H
+#define SHADER_PROGRAM_H
+
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+#include <GL/glew.h>
+
+/// What a program is built from. Each stage gets its defines and then the
+/// text of its includes inserted right after the #version line of its file
+/// (see vertex_format.glsl).
+struct ProgramSource
+{
+    std::string vertexFile;
+    std::string fragmentFile;
+    std::string vertexDefines;               // e.g. "#define PACKED_VERTICES\n"
+    std::vector<std::string> vertexIncludes; // in order
+    std::vector<std::string> fragmentIncludes;
+    std::vector<std::pair<std::string, GLuint>> attribLocations; // bound before linking
+
+    /// Every file the program is read from
+    std::vector<std::string> files() const;
+};
+
+/// Both stages of a ProgramSource as the GL gets them
+struct ProgramText
+{
+    std::string vertex;
+    std::string fragment;
+};
+
+/// Appends the contents of fileName to data. Returns false if it cannot be read.
+bool ReadDataFromFile(const std::string& fileName, std::string& data);
+
+/// Reads the files of source into text, printing which one is missing if
+/// any. Makes no GL calls, so any thread may do it.
+bool ReadProgramText(const ProgramSource& source, ProgramText& text);
+
+/// How the programs of this run were built
+struct ProgramBuildStats
+{
+    int fromCache = 0;     // loaded with glProgramBinary
+    int compiled = 0;      // compiled and linked from source
+    int cacheRejected = 0; // entries the driver refused, compiled instead
+    double ms = 0;         // in BuildProgram, reading the sources included
+};
+
+extern ProgramBuildStats gProgramBuildStats;
+
+/// A program between BeginProgramBuild and FinishProgramBuild
+struct ProgramBuild
+{
+    GLuint program = 0;
+    GLuint vertexShader = 0;
+    GLuint fragmentShader = 0;
+    uint64_t hash = 0; // binary cache key, 0 when the cache is not used
+    bool fromCache = false;
+};
+
+/// Loads text from the on-disk binary cache or starts compiling and linking
+/// it. The cache key is a hash of both stages' text, the attribute locations
+/// and the GL vendor, renderer and version strings; an entry that is missing
+/// or rejected by the driver means compiling from source. Where the driver
+/// has KHR_parallel_shader_compile it compiles and links on threads of its
+/// own and this returns without waiting for it.
+void BeginProgramBuild(const ProgramSource& source, const ProgramText& text, ProgramBuild& build);
+
+/// Whether FinishProgramBuild would return without waiting for the driver
+bool IsProgramBuildDone(const ProgramBuild& build);
+
+/// Returns the linked program, having saved it to the binary cache, or 0
+/// after printing the info logs when a stage does not compile or the
+/// program does not link. Resets build.
+GLuint FinishProgramBuild(const ProgramSource& source, ProgramBuild& build);
+
+/// Drops a build that is no longer wanted
+void CancelProgramBuild(ProgramBuild& build);
+
+/// Reads, begins and finishes a build in one go; 0 if any of it fails
+GLuint BuildProgram(const ProgramSource& source);
+
+#endif
@@ -0,0 +1,179 @@
+#include "shader_watcher.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#include "log.h"
+
+using namespace std;
+
+namespace
+{
+
+/// Saving a file can take several events (truncate, write, rename); changes
+/// are read once no event came for this long
+const int kSettleMs = 50;
+
+/// "dir/" for "dir/name", "" for a bare name
+string directoryPrefix(const string& file)
+{
+    size_t slash = file.rfind('/');
+    return slash == string::npos ? "" : file.substr(0, slash + 1);
+}
+
+} // namespace
+
+void ShaderWatcher::watch(int id, const ProgramSource& source)
+{
+    programs.emplace_back(id, source);
+}
+
+bool ShaderWatcher::start()
+{
+    inotifyFd = inotify_init1(IN_CLOEXEC);
+    wakeFd = eventfd(0, EFD_CLOEXEC);
+    if (inotifyFd < 0 || wakeFd < 0)
+    {
+        perror("Shader hot reload unavailable");
+        stop();
+        return false;
+    }
+
+    for (const auto& program : programs)
+    {
+        for (const string& file : program.second.files())
+        {
+            string prefix = directoryPrefix(file);
+            bool known = any_of(directories.begin(), directories.end(),
+                                [&](const pair<int, string>& d) { return d.second == prefix; });
+            if (known) continue;
+
+            int wd = inotify_add_watch(inotifyFd, prefix.empty() ? "." : prefix.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO);
+            if (wd < 0)
+            {
+                perror("Shader hot reload unavailable");
+                stop();
+                return false;
+            }
+            directories.emplace_back(wd, prefix);
+        }
+    }
+
+    thread = std::thread(&ShaderWatcher::run, this);
+    return true;
+}
+
+void ShaderWatcher::stop()
+{
+    if (thread.joinable())
+    {
+        uint64_t one = 1;
+        if (write(wakeFd, &one, sizeof(one)) != sizeof(one))
+        {
+            perror("eventfd");
+        }
+        thread.join();
+    }
+    for (int* fd : { &inotifyFd, &wakeFd })
+    {
+        if (*fd >= 0)
+        {
+            close(*fd);
+            *fd = -1;
+        }
+    }
+    directories.clear();
+}
+
+bool ShaderWatcher::takeChanged(int& id, ProgramText& text)
+{
+    lock_guard<mutex> lock(changedMutex);
+    if (changed.empty())
+    {
+        return false;
+    }
+    id = changed.front().first;
+    text = move(changed.front().second);
+    changed.erase(changed.begin());
+    return true;
+}
+
+void ShaderWatcher::run()
+{
+    pollfd fds[2] = { { inotifyFd, POLLIN, 0 }, { wakeFd, POLLIN, 0 } };
+    alignas(inotify_event) char buffer[4096];
+    vector<string> changedFiles;
+    while (true)
+    {
+        int ready = poll(fds, 2, changedFiles.empty() ? -1 : kSettleMs);
+        if (ready < 0 && errno != EINTR)
+        {
+            perror("Shader hot reload stopped");
+            return;
+        }
+        if (ready > 0 && (fds[1].revents & POLLIN))
+        {
+            return;
+        }
+        if (ready == 0)
+        {
+            reread(changedFiles);
+            changedFiles.clear();
+            continue;
+        }
+        if (ready < 0 || !(fds[0].revents & POLLIN))
+        {
+            continue;
+        }
+
+        ssize_t length = read(inotifyFd, buffer, sizeof(buffer));
+        for (ssize_t offset = 0; offset < length; )
+        {
+            const inotify_event* event = (const inotify_event*) (buffer + offset);
+            offset += sizeof(inotify_event) + event->len;
+            if (event->len == 0) continue;
+
+            for (const auto& directory : directories)
+            {
+                if (directory.first == event->wd)
+                {
+                    changedFiles.push_back(directory.second + event->name);
+                }
+            }
+        }
+    }
+}
+
+void ShaderWatcher::reread(const vector<string>& changedFiles)
+{
+    for (const auto& program : programs)
+    {
+        vector<string> files = program.second.files();
+        bool affected = any_of(files.begin(), files.end(), [&](const string& file) {
+            return find(changedFiles.begin(), changedFiles.end(), file) != changedFiles.end();
+        });
+        if (!affected) continue;
+
+        // a file may be missing for a moment while an editor replaces it; the
+        // event of its return brings it back here
+        ProgramText text;
+        if (!ReadProgramText(program.second, text)) continue;
+
+        LOG_INFO("Reloading %s and %s", program.second.vertexFile.c_str(), program.second.fragmentFile.c_str());
+        lock_guard<mutex> lock(changedMutex);
+        auto same = find_if(changed.begin(), changed.end(),
+                            [&](const pair<int, ProgramText>& c) { return c.first == program.first; });
+        if (same != changed.end())
+        {
+            same->second = move(text);
+        }
+        else
+        {
+            changed.emplace_back(program.first, move(text));
+        }
+    }
+}
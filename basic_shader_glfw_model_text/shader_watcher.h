@@ -0,0 +1,47 @@
+#ifndef SHADER_WATCHER_H
+#define SHADER_WATCHER_H
+
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+#include "shader_program.h"
+
+/// Watches the files of a set of programs with inotify. When some change,
+/// the programs that read them are read again on the watcher's thread and
+/// handed over as ProgramText, so the render thread only has to compile.
+/// Directories are watched rather than files, which also catches editors
+/// that save by renaming a new file over the old one.
+class ShaderWatcher
+{
+public:
+    ~ShaderWatcher() { stop(); }
+
+    /// Reports changes to the files of source under id; call before start()
+    void watch(int id, const ProgramSource& source);
+
+    /// Returns false, having printed why, if the files cannot be watched
+    bool start();
+    void stop();
+
+    /// Render thread: the next program whose files changed since it was
+    /// last taken, as read after the change. Never blocks.
+    bool takeChanged(int& id, ProgramText& text);
+
+private:
+    void run();
+    void reread(const std::vector<std::string>& changedFiles);
+
+    std::vector<std::pair<int, ProgramSource>> programs;
+    std::vector<std::pair<int, std::string>> directories; // inotify watch, directory prefix of its files
+
+    std::mutex changedMutex;
+    std::vector<std::pair<int, ProgramText>> changed; // at most one entry per id
+
+    int inotifyFd = -1;
+    int wakeFd = -1; // stop() makes this readable
+    std::thread thread;
+};
+
+#endif
@@ -0,0 +1,355 @@
+#include "simulation.h"
+#include "log.h"
+#include "profile.h"
+
+#include <chrono>
+#include <cstdlib>
+#include <algorithm>
+#include <functional>
+
+using namespace std;
+
+namespace
+{
+
+// how long a matched cell bubbles before it pops: about a second
+const int kBubbleSteps = 67;
+
+// fewer cells than this per thread at or above the holes are compacted on one thread
+const int kMinCellsPerThread = 1 << 18;
+
+int getRandomIndex() {
+    int num = (rand() % (2 - 0 + 1)) + 0;
+    if (num==2) {num=3;}
+    return num;
+}
+
+double elapsedMs(chrono::steady_clock::time_point from, chrono::steady_clock::time_point to)
+{
+    return chrono::duration<double, milli>(to - from).count();
+}
+
+} // namespace
+
+void SnapshotBuffer::publish()
+{
+    // release makes the filled slot visible to the reader, acquire gets back
+    // the slot the reader last let go of
+    int previous = middle.exchange(backIndex | kFresh, memory_order_acq_rel);
+    backIndex = previous & ~kFresh;
+}
+
+const BoardSnapshot& SnapshotBuffer::acquire()
+{
+    if (middle.load(memory_order_relaxed) & kFresh)
+    {
+        int previous = middle.exchange(frontIndex, memory_order_acq_rel);
+        frontIndex = previous & ~kFresh;
+    }
+    return slots[frontIndex];
+}
+
+void Simulation::reset(int numRows, int numCols)
+{
+    rows = numRows;
+    cols = numCols;
+    moves = 0;
+    score = 0;
+    steps = 0;
+    selectionCounter = 0;
+
+    grid.reset(rows, cols);
+    matches.reset(rows, cols);
+    lowestHole.assign(cols, -1);
+    holes.assign(cols, 0);
+    holeColumns.clear();
+    for(int n = 0; n < rows * cols; n++) {
+        grid.assign(n, getRandomIndex(), kEnabled);
+    }
+
+    // nothing has happened yet; show the board as dealt
+    BoardSnapshot& snapshot = snapshots.back();
+    snapshot.rows = rows;
+    snapshot.cols = cols;
+    snapshot.cells.resize(rows * cols);
+    for(int i = 0; i < rows; i++) {
+        for(int j = 0; j < cols; j++) {
+            snapshot.cells[i * cols + j] = { grid.colors[grid.index(i, j)], true, -1.f };
+        }
+    }
+    snapshot.moves = moves;
+    snapshot.score = score;
+    snapshot.step = steps;
+    snapshots.publish();
+}
+
+void Simulation::select(int i, int j)
+{
+    lock_guard<mutex> lock(selectionMutex);
+    pendingSelections.push_back(make_pair(i, j));
+}
+
+void Simulation::applySelections()
+{
+    {
+        lock_guard<mutex> lock(selectionMutex);
+        selections.swap(pendingSelections);
+    }
+
+    for (const auto& cell : selections)
+    {
+        int i = cell.first, j = cell.second;
+        if (i < 0 || i >= rows || j < 0 || j >= cols) continue;
+
+        int n = grid.index(i, j);
+        grid.setFlags(n, grid.flags[n] | kSelected);
+        moves++;
+        LOG_INFO("selected: %d %d", i, j);
+    }
+    selections.clear();
+}
+
+Simulation::~Simulation()
+{
+    stop();
+    stopWorkers();
+}
+
+/// Empties cell (i, j) and records the hole for the next refill
+void Simulation::clearCell(int i, int j)
+{
+    grid.setFlags(grid.index(i, j), 0);
+    if (holes[j]++ == 0)
+    {
+        holeColumns.push_back(j);
+    }
+    lowestHole[j] = max(lowestHole[j], i);
+}
+
+/// Lets the enabled cells of holeColumns[first, end) fall onto each other
+/// in one pass up from the lowest hole, keeping their order, which leaves
+/// the holes at the top. Leaves the masks stale; columns share mask words.
+void Simulation::compactColumns(int first, int end)
+{
+    for (int c = first; c < end; ++c)
+    {
+        int j = holeColumns[c];
+        int write = lowestHole[j];
+        for (int i = lowestHole[j]; i >= 0; --i)
+        {
+            int n = grid.index(i, j);
+            if (!grid.has(n, kEnabled)) continue;
+            if (write != i)
+            {
+                grid.moveCellUnsynced(n, grid.index(write, j));
+            }
+            --write;
+        }
+    }
+}
+
+void Simulation::compactWorker(int worker)
+{
+    ProfileThreadName("compaction worker");
+    uint64_t round = 0;
+    unique_lock<mutex> lock(workMutex);
+    while (true)
+    {
+        workReady.wait(lock, [&] { return workersQuit || workRound != round; });
+        if (workersQuit) return;
+        round = workRound;
+        if (worker >= workParts) continue;
+
+        int first = holeColumns.size() * worker / workParts;
+        int end = holeColumns.size() * (worker + 1) / workParts;
+        lock.unlock();
+        compactColumns(first, end);
+        lock.lock();
+        if (--workPending == 0)
+        {
+            workDone.notify_one();
+        }
+    }
+}
+
+void Simulation::stopWorkers()
+{
+    {
+        lock_guard<mutex> lock(workMutex);
+        workersQuit = true;
+    }
+    workReady.notify_all();
+    for (std::thread& worker : workers)
+    {
+        worker.join();
+    }
+    workers.clear();
+    workersQuit = false;
+}
+
+void Simulation::refill()
+{
+    PROFILE_SCOPE("Simulation::refill");
+    if (holeColumns.empty())
+    {
+        return;
+    }
+    // new colors are drawn in column order, so they don't depend on the
+    // order the cells were cleared in or on the threads
+    sort(holeColumns.begin(), holeColumns.end());
+
+    // columns are independent, so many cells to move are split across the
+    // workers; only the cells at or above a column's lowest hole move
+    size_t moving = 0;
+    for (int j : holeColumns)
+    {
+        moving += lowestHole[j] + 1;
+    }
+    int numThreads = (int) min<size_t>(max(1u, thread::hardware_concurrency()), max<size_t>(1, moving / kMinCellsPerThread));
+    numThreads = min(numThreads, (int) holeColumns.size());
+    if (numThreads > 1)
+    {
+        while ((int) workers.size() < numThreads - 1)
+        {
+            workers.emplace_back(&Simulation::compactWorker, this, (int) workers.size() + 1);
+        }
+        {
+            lock_guard<mutex> lock(workMutex);
+            workParts = numThreads;
+            workPending = numThreads - 1;
+            ++workRound;
+        }
+        workReady.notify_all();
+        compactColumns(0, holeColumns.size() / numThreads);
+        unique_lock<mutex> lock(workMutex);
+        workDone.wait(lock, [&] { return workPending == 0; });
+    }
+    else
+    {
+        compactColumns(0, holeColumns.size());
+    }
+
+    // everything at or above a column's lowest hole moved or is new
+    for (int j : holeColumns) {
+        for(int i = 0; i < holes[j]; i++) {
+            int n = grid.index(i, j);
+            grid.colors[n] = getRandomIndex();
+            grid.flags[n] = kEnabled;
+            grid.bubbleSteps[n] = 0;
+        }
+        for(int i = 0; i <= lowestHole[j]; i++) {
+            grid.syncMasks(grid.index(i, j));
+            matches.markDirty(i, j);
+        }
+        holes[j] = 0;
+        lowestHole[j] = -1;
+    }
+    holeColumns.clear();
+}
+
+void Simulation::step()
+{
+    PROFILE_SCOPE("Simulation::step");
+    applySelections();
+
+    // refill first so that runs are only looked for on a full board
+    auto gridStart = chrono::steady_clock::now();
+    refill();
+    auto matchStart = chrono::steady_clock::now();
+    matches.findMatches(grid);
+    auto animateStart = chrono::steady_clock::now();
+
+    // advance the animations and record what every cell looks like now
+    BoardSnapshot& snapshot = snapshots.back();
+    snapshot.rows = rows;
+    snapshot.cols = cols;
+    snapshot.cells.resize(rows * cols);
+
+    for(int i = 0; i < rows; i++){
+        for(int j = 0; j < cols; j++){
+            int n = grid.index(i, j);
+            float scale = -1;
+
+            // the cells of a run are matched in the same step, so they pop together
+            if((grid.flags[n] & (kMatched | kEnabled)) == (kMatched | kEnabled)){
+                LOG_TRACE("Bubbling: %d %d %d", i, j, grid.bubbleSteps[n]);
+                if(grid.bubbleSteps[n]<kBubbleSteps){
+                    scale = (float) grid.bubbleSteps[n]/kBubbleSteps;
+                    grid.bubbleSteps[n]++;
+                }else{
+                    grid.bubbleSteps[n] = 0;
+                    clearCell(i, j);
+                    score++;
+                }
+            }
+
+            if(grid.has(n, kSelected)){
+                // first element
+                if(selectionCounter<100){
+                    scale = selectionCounter/100;
+                    selectionCounter++;
+                }else{
+                    selectionCounter = 0;
+                    score++;
+                    clearCell(i, j);
+                }
+            }
+
+            // a cell scaled to 0 covers no pixels
+            snapshot.cells[n] = { grid.colors[n], grid.has(n, kEnabled) && scale != 0, scale };
+        }
+    }
+
+    snapshot.moves = moves;
+    snapshot.score = score;
+    snapshot.step = ++steps;
+    snapshots.publish();
+
+    stepTimes.colorMatch = elapsedMs(matchStart, animateStart);
+    stepTimes.gridUpdate = elapsedMs(gridStart, matchStart) + elapsedMs(animateStart, chrono::steady_clock::now());
+}
+
+void Simulation::start()
+{
+    if (running)
+    {
+        return;
+    }
+    running = true;
+    thread = std::thread(&Simulation::run, this);
+}
+
+void Simulation::stop()
+{
+    running = false;
+    if (thread.joinable())
+    {
+        thread.join();
+    }
+}
+
+void Simulation::run()
+{
+    ProfileThreadName("simulation");
+    typedef chrono::steady_clock Clock;
+    const Clock::duration stepDuration = chrono::duration_cast<Clock::duration>(chrono::duration<double>(kStepSeconds));
+    // after a stall (debugger, suspended laptop) don't try to catch up more than this
+    const int maxCatchUpSteps = 10;
+
+    Clock::time_point nextStep = Clock::now();
+    while (running)
+    {
+        int stepsTaken = 0;
+        while (Clock::now() >= nextStep && stepsTaken < maxCatchUpSteps)
+        {
+            step();
+            nextStep += stepDuration;
+            ++stepsTaken;
+        }
+        if (stepsTaken == maxCatchUpSteps)
+        {
+            nextStep = Clock::now() + stepDuration;
+        }
+        this_thread::sleep_until(nextStep);
+    }
+}
@@ -0,0 +1,139 @@
+#ifndef SIMULATION_H
+#define SIMULATION_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+#include "board.h"
+#include "match_engine.h"
+
+/// What the renderer needs to know about one cell
+struct CellView
+{
+    uint8_t color;  // gProgram slot
+    bool visible;
+    float scale;    // animated size, or < 0 for the resting size (which depends on the window)
+};
+
+/// Copy of the board taken at the end of a simulation step. The renderer
+/// only ever reads it; the simulation never touches it again once published.
+struct BoardSnapshot
+{
+    int rows = 0, cols = 0;
+    std::vector<CellView> cells; // row-major
+    int moves = 0;
+    int score = 0;
+    uint64_t step = 0;
+
+    const CellView& cell(int i, int j) const { return cells[i * cols + j]; }
+};
+
+/// Triple buffer handing snapshots from one writer thread to one reader
+/// thread without locks. The writer fills back() and publishes it by
+/// swapping it with the middle slot; the reader swaps the middle slot into
+/// the front when it holds something newer. Neither ever waits for the other.
+class SnapshotBuffer
+{
+public:
+    /// Writer: the slot to fill next
+    BoardSnapshot& back() { return slots[backIndex]; }
+
+    /// Writer: makes back() the latest snapshot
+    void publish();
+
+    /// Reader: the latest published snapshot; valid until the next call
+    const BoardSnapshot& acquire();
+
+private:
+    static const int kFresh = 4; // set in middle when the writer published since the last acquire
+
+    BoardSnapshot slots[3];
+    int backIndex = 0;
+    int frontIndex = 1;
+    std::atomic<int> middle{ 2 };
+};
+
+/// CPU time of the parts of the last simulation step, in ms
+struct StepTimes
+{
+    double colorMatch = 0; // finding new runs
+    double gridUpdate = 0; // gravity, refilling cleared cells and advancing the animations
+};
+
+/// The game logic. Owns the board and advances it in fixed steps of
+/// kStepSeconds, so animations take the same time at any frame rate, and
+/// publishes a BoardSnapshot after every step. start() runs the steps on
+/// a thread of its own; the benchmarks call step() themselves instead so
+/// that every frame sees exactly one step.
+class Simulation
+{
+public:
+    static constexpr double kStepSeconds = 1.0 / 60;
+
+    ~Simulation();
+
+    /// New rows x cols board with random colors; the simulation must not be running
+    void reset(int numRows, int numCols);
+
+    /// Queues selecting cell (i, j) for the next step. Any thread.
+    void select(int i, int j);
+
+    /// Applies queued selections, refills, matches and animates once
+    void step();
+
+    void start();
+    void stop();
+
+    /// Render thread: the board as of the most recent step
+    const BoardSnapshot& latest() { return snapshots.acquire(); }
+
+    /// Only safe to read while the simulation is not running
+    const Board& board() const { return grid; }
+    const StepTimes& lastStepTimes() const { return stepTimes; }
+
+private:
+    void clearCell(int i, int j);
+    void refill();
+    void compactColumns(int first, int end);
+    void compactWorker(int worker);
+    void stopWorkers();
+    void applySelections();
+    void run();
+
+    int rows = 0, cols = 0;
+    Board grid;
+    MatchEngine matches;
+    // per column, counted by clearCell since the last refill: lowest row
+    // that was emptied (-1 if none) and the number of empty cells. Only
+    // holeColumns, the columns that have any, are compacted and refilled.
+    std::vector<int> lowestHole, holes;
+    std::vector<int> holeColumns;
+    int moves = 0;
+    int score = 0;
+    uint64_t steps = 0;
+    double selectionCounter = 0; // shared by all selected cells
+    StepTimes stepTimes;
+
+    std::mutex selectionMutex;
+    std::vector<std::pair<int, int>> pendingSelections, selections;
+
+    // compaction workers, started by the first refill with enough cells to
+    // move. Worker w takes part w of holeColumns each time workRound changes.
+    std::vector<std::thread> workers;
+    std::mutex workMutex;
+    std::condition_variable workReady, workDone;
+    uint64_t workRound = 0;
+    int workParts = 0;   // of this round; the calling thread does part 0
+    int workPending = 0; // parts still being compacted by workers
+    bool workersQuit = false;
+
+    SnapshotBuffer snapshots;
+    std::thread thread;
+    std::atomic<bool> running{ false };
+};
+
+#endif
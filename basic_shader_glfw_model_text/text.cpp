@@ -0,0 +1,340 @@
+#include "text.h"
+#include "gl_state.h"
+#include "file_util.h"
+#include "profile.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/type_ptr.hpp>
+#include <ft2build.h>
+#include FT_FREETYPE_H
+
+using namespace std;
+
+namespace
+{
+
+const int kAtlasWidth = 1024;
+const int kGlyphPadding = 1; // empty texels around every glyph so linear filtering doesn't bleed
+
+/// All glyph bitmaps packed into one single-channel image, plus their metrics
+struct GlyphAtlas
+{
+    int width = kAtlasWidth;
+    int height = 0;
+    vector<unsigned char> pixels;
+    Character glyphs[128];
+};
+
+GLuint gTextProgram;
+GLuint gAtlasTexture;
+Character Characters[128];
+
+/// Rasterizes the first 128 ASCII glyphs and packs them row by row
+bool buildGlyphAtlas(const char* fontPath, int pixelSize, GlyphAtlas& atlas)
+{
+    // FreeType
+    FT_Library ft;
+    // All functions return a value different than 0 whenever an error occurred
+    if (FT_Init_FreeType(&ft))
+    {
+        std::cout << "ERROR::FREETYPE: Could not init FreeType Library" << std::endl;
+        return false;
+    }
+
+    // Load font as face
+    FT_Face face;
+    if (FT_New_Face(ft, fontPath, 0, &face))
+    {
+        std::cout << "ERROR::FREETYPE: Failed to load font" << std::endl;
+        FT_Done_FreeType(ft);
+        return false;
+    }
+
+    // Set size to load glyphs as
+    FT_Set_Pixel_Sizes(face, 0, pixelSize);
+
+    int penX = kGlyphPadding, penY = kGlyphPadding, rowHeight = 0;
+
+    // Load first 128 characters of ASCII set
+    for (GLubyte c = 0; c < 128; c++)
+    {
+        Character& ch = atlas.glyphs[c];
+        ch = Character();
+
+        // Load character glyph
+        if (FT_Load_Char(face, c, FT_LOAD_RENDER))
+        {
+            std::cout << "ERROR::FREETYTPE: Failed to load Glyph" << std::endl;
+            continue;
+        }
+
+        const FT_Bitmap& bitmap = face->glyph->bitmap;
+        int w = bitmap.width, h = bitmap.rows;
+
+        // start a new shelf when this glyph doesn't fit on the current one
+        if (penX + w + kGlyphPadding > atlas.width)
+        {
+            penX = kGlyphPadding;
+            penY += rowHeight + kGlyphPadding;
+            rowHeight = 0;
+        }
+        if (penY + h + kGlyphPadding > atlas.height)
+        {
+            atlas.height = penY + h + kGlyphPadding;
+            atlas.pixels.resize((size_t) atlas.width * atlas.height, 0);
+        }
+
+        for (int row = 0; row < h; ++row)
+        {
+            memcpy(&atlas.pixels[(size_t) (penY + row) * atlas.width + penX], bitmap.buffer + row * bitmap.pitch, w);
+        }
+
+        ch.Size = glm::ivec2(w, h);
+        ch.Bearing = glm::ivec2(face->glyph->bitmap_left, face->glyph->bitmap_top);
+        ch.Advance = face->glyph->advance.x;
+        ch.UV = glm::vec4(penX, penY, penX + w, penY + h); // in texels until the height is final
+
+        penX += w + kGlyphPadding;
+        rowHeight = max(rowHeight, h);
+    }
+
+    // Destroy FreeType once we're finished
+    FT_Done_Face(face);
+    FT_Done_FreeType(ft);
+
+    for (Character& ch : atlas.glyphs)
+    {
+        ch.UV = glm::vec4(ch.UV.x / atlas.width, ch.UV.y / max(atlas.height, 1),
+                          ch.UV.z / atlas.width, ch.UV.w / max(atlas.height, 1));
+    }
+    return true;
+}
+
+const uint32_t kFontCacheVersion = 1;
+
+/// On-disk layout: header, font path, glyph metrics, atlas pixels
+struct FontCacheHeader
+{
+    char magic[4];
+    uint32_t version;
+    uint64_t fontSize;
+    int64_t fontMtimeNs;
+    uint32_t pixelSize;
+    uint32_t width;
+    uint32_t height;
+    uint32_t pathLength;
+};
+
+/// Character with fixed-size fields, as stored in the cache
+struct CachedGlyph
+{
+    int32_t size[2];
+    int32_t bearing[2];
+    uint32_t advance;
+    float uv[4];
+};
+
+string fontCachePath(const FileKey& key, int pixelSize)
+{
+    uint64_t hash = HashBytes(key.path.data(), key.path.size());
+    hash = HashBytes(&pixelSize, sizeof(pixelSize), hash);
+    return CacheFilePath("font", hash, ".bin");
+}
+
+bool loadFontCache(const FileKey& key, int pixelSize, GlyphAtlas& atlas)
+{
+    MappedFile file;
+    if (!file.open(fontCachePath(key, pixelSize)) || file.size < sizeof(FontCacheHeader))
+    {
+        return false;
+    }
+
+    FontCacheHeader header;
+    memcpy(&header, file.data, sizeof(header));
+
+    size_t glyphOffset = sizeof(header) + header.pathLength;
+    size_t pixelOffset = glyphOffset + 128 * sizeof(CachedGlyph);
+    size_t pixelBytes = (size_t) header.width * header.height;
+
+    bool valid = memcmp(header.magic, "HW3F", 4) == 0 &&
+                 header.version == kFontCacheVersion &&
+                 header.fontSize == key.size &&
+                 header.fontMtimeNs == key.mtimeNs &&
+                 header.pixelSize == (uint32_t) pixelSize &&
+                 file.size == pixelOffset + pixelBytes &&
+                 key.path.compare(0, string::npos, file.data + sizeof(header), header.pathLength) == 0;
+    if (!valid)
+    {
+        return false;
+    }
+
+    for (int c = 0; c < 128; ++c)
+    {
+        CachedGlyph g;
+        memcpy(&g, file.data + glyphOffset + c * sizeof(CachedGlyph), sizeof(g));
+        Character& ch = atlas.glyphs[c];
+        ch.Size = glm::ivec2(g.size[0], g.size[1]);
+        ch.Bearing = glm::ivec2(g.bearing[0], g.bearing[1]);
+        ch.Advance = g.advance;
+        ch.UV = glm::vec4(g.uv[0], g.uv[1], g.uv[2], g.uv[3]);
+    }
+    atlas.width = header.width;
+    atlas.height = header.height;
+    atlas.pixels.assign(file.data + pixelOffset, file.data + pixelOffset + pixelBytes);
+    return true;
+}
+
+bool saveFontCache(const FileKey& key, int pixelSize, const GlyphAtlas& atlas)
+{
+    FontCacheHeader header = {};
+    memcpy(header.magic, "HW3F", 4);
+    header.version = kFontCacheVersion;
+    header.fontSize = key.size;
+    header.fontMtimeNs = key.mtimeNs;
+    header.pixelSize = pixelSize;
+    header.width = atlas.width;
+    header.height = atlas.height;
+    header.pathLength = key.path.size();
+
+    CachedGlyph glyphs[128];
+    for (int c = 0; c < 128; ++c)
+    {
+        const Character& ch = atlas.glyphs[c];
+        glyphs[c] = { { ch.Size.x, ch.Size.y }, { ch.Bearing.x, ch.Bearing.y }, ch.Advance,
+                      { ch.UV.x, ch.UV.y, ch.UV.z, ch.UV.w } };
+    }
+
+    const void* parts[] = { &header, key.path.data(), glyphs, atlas.pixels.data() };
+    size_t sizes[] = { sizeof(header), key.path.size(), sizeof(glyphs), atlas.pixels.size() };
+    return WriteFileAtomic(fontCachePath(key, pixelSize), parts, sizes, 4);
+}
+
+} // namespace
+
+void TextBatch::clear()
+{
+    vertices.clear();
+    dirty = true;
+}
+
+void TextBatch::append(const std::string& text, GLfloat x, GLfloat y, GLfloat scale)
+{
+    vertices.reserve(vertices.size() + text.size() * 6 * 4);
+
+    // Iterate through all characters
+    for (unsigned char c : text)
+    {
+        if (c >= 128) continue;
+        const Character& ch = Characters[c];
+
+        GLfloat xpos = x + ch.Bearing.x * scale;
+        GLfloat ypos = y - (ch.Size.y - ch.Bearing.y) * scale;
+
+        GLfloat w = ch.Size.x * scale;
+        GLfloat h = ch.Size.y * scale;
+
+        GLfloat u0 = ch.UV.x, v0 = ch.UV.y, u1 = ch.UV.z, v1 = ch.UV.w;
+        GLfloat quad[6][4] = {
+            { xpos,     ypos + h,   u0, v0 },
+            { xpos,     ypos,       u0, v1 },
+            { xpos + w, ypos,       u1, v1 },
+
+            { xpos,     ypos + h,   u0, v0 },
+            { xpos + w, ypos,       u1, v1 },
+            { xpos + w, ypos + h,   u1, v0 }
+        };
+        vertices.insert(vertices.end(), &quad[0][0], &quad[0][0] + 6 * 4);
+
+        // Now advance cursors for next glyph (note that advance is number of 1/64 pixels)
+        x += (ch.Advance >> 6) * scale; // Bitshift by 6 to get value in pixels (2^6 = 64 (divide amount of 1/64th pixels by 64 to get amount of pixels))
+    }
+    dirty = true;
+}
+
+void initFonts(GLuint program, int windowWidth, int windowHeight)
+{
+    PROFILE_SCOPE("initFonts");
+    gTextProgram = program;
+
+    // Set OpenGL options
+    //glEnable(GL_CULL_FACE);
+    glEnable(GL_BLEND);
+    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+
+    glm::mat4 projection = glm::ortho(0.0f, static_cast<GLfloat>(windowWidth), 0.0f, static_cast<GLfloat>(windowHeight));
+    glUseProgram(program);
+    glUniformMatrix4fv(glGetUniformLocation(program, "projection"), 1, GL_FALSE, glm::value_ptr(projection));
+
+    auto start = chrono::steady_clock::now();
+    const char* fontPath = "/usr/share/fonts/truetype/liberation/LiberationSerif-Italic.ttf";
+    const int pixelSize = 48;
+
+    // a warm start reads the rasterized atlas back and never touches FreeType
+    GlyphAtlas atlas;
+    FileKey key;
+    bool haveKey = gCacheEnabled && GetFileKey(fontPath, key);
+    bool cached = haveKey && loadFontCache(key, pixelSize, atlas);
+    if (!cached && buildGlyphAtlas(fontPath, pixelSize, atlas) && haveKey)
+    {
+        saveFontCache(key, pixelSize, atlas);
+    }
+    copy(begin(atlas.glyphs), end(atlas.glyphs), Characters);
+
+    cout << "Glyph atlas " << (cached ? "loaded from cache" : "rasterized") << " in "
+         << chrono::duration<double, milli>(chrono::steady_clock::now() - start).count() << " ms" << endl;
+
+    // Disable byte-alignment restriction
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+
+    // one atlas texture holds every glyph, shelf-packed
+    glGenTextures(1, &gAtlasTexture);
+    glBindTexture(GL_TEXTURE_2D, gAtlasTexture);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RED, atlas.width, atlas.height, 0, GL_RED, GL_UNSIGNED_BYTE,
+                 atlas.pixels.empty() ? NULL : atlas.pixels.data());
+    // Set texture options
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    glEnableVertexAttribArray(2);
+}
+
+void drawTextBatch(TextBatch& batch)
+{
+    PROFILE_GPU_SCOPE("drawTextBatch");
+    if (batch.vertices.empty())
+    {
+        return;
+    }
+
+    // Activate corresponding render state
+    UseProgram(gTextProgram);
+    glUniform3f(Uniforms(gTextProgram).textColor, batch.color.x, batch.color.y, batch.color.z);
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, gAtlasTexture);
+
+    if (!batch.vbo)
+    {
+        glGenBuffers(1, &batch.vbo);
+    }
+    BindBuffer(GL_ARRAY_BUFFER, batch.vbo);
+    if (batch.dirty)
+    {
+        glBufferData(GL_ARRAY_BUFFER, batch.vertices.size() * sizeof(GLfloat), batch.vertices.data(), GL_DYNAMIC_DRAW);
+        batch.uploadedVertexCount = batch.vertices.size() / 4;
+        batch.dirty = false;
+    }
+    SetVertexAttribPointer(2, 4, GL_FLOAT, GL_FALSE, 4 * sizeof(GLfloat), 0);
+
+    // Render all quads
+    glDrawArrays(GL_TRIANGLES, 0, batch.uploadedVertexCount);
+    CountDrawCall();
+
+    glBindTexture(GL_TEXTURE_2D, 0);
+}
@@ -0,0 +1,42 @@
+#ifndef TEXT_H
+#define TEXT_H
+
+#include <string>
+#include <vector>
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+/// Holds all state information relevant to a character as loaded using FreeType
+struct Character {
+    glm::ivec2 Size;    // Size of glyph
+    glm::ivec2 Bearing;  // Offset from baseline to left/top of glyph
+    GLuint Advance;    // Horizontal offset to advance to next glyph
+    glm::vec4 UV;       // Where the glyph is in the atlas: left, top, right, bottom
+};
+
+/// Glyph quads of one or more strings that are drawn with a single draw call.
+/// The vertices are uploaded to the batch's own buffer only after they change.
+struct TextBatch
+{
+    std::vector<GLfloat> vertices; // 6 vertices of <vec2 pos, vec2 tex> per glyph
+    glm::vec3 color = glm::vec3(1, 1, 1);
+    GLuint vbo = 0;
+    GLsizei uploadedVertexCount = 0;
+    bool dirty = true;
+
+    void clear();
+
+    /// Lays text out starting at window position (x, y), glyphs scaled by scale
+    void append(const std::string& text, GLfloat x, GLfloat y, GLfloat scale);
+};
+
+/// Rasterizes the first 128 ASCII glyphs into a single atlas texture.
+/// The atlas is cached in gCacheDir, keyed by font path, pixel size and the
+/// font's mtime, so a warm start doesn't call FreeType at all.
+/// program is the text shader (vert_text/frag_text).
+void initFonts(GLuint program, int windowWidth, int windowHeight);
+
+/// Uploads the batch if it changed and draws all of its glyphs at once
+void drawTextBatch(TextBatch& batch);
+
+#endif
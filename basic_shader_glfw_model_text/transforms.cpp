@@ -0,0 +1,149 @@
+#include "transforms.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <glm/gtc/matrix_transform.hpp>
+
+using namespace std;
+
+void CellTranslation(int rows, int cols, int i, int j, double& xt, double& yt)
+{
+    xt = (j)*(20./cols)-10+1.5;
+    yt = 10-i*(20./rows)-1.5;
+}
+
+bool PickCell(int rows, int cols, int width, int height, double x, double y, int& i, int& j)
+{
+    const double hitRadius = 15; // pixels
+
+    // window to world, then invert CellTranslation and round to the nearest cell
+    double xt = x / width * 20 - 10;
+    double yt = 10 - y / height * 20;
+    // the layout isn't centered, so the nearest cell can be an edge cell from outside the grid
+    i = min(max((int) lround((10 - 1.5 - yt) / (20. / rows)), 0), rows - 1);
+    j = min(max((int) lround((xt + 10 - 1.5) / (20. / cols)), 0), cols - 1);
+
+    CellTranslation(rows, cols, i, j, xt, yt);
+    double centerX = (xt + 10) / 20 * width;
+    double centerY = (-yt + 10) / 20 * height;
+    return fabs(x - centerX) < hitRadius && fabs(y - centerY) < hitRadius;
+}
+
+void BoardTransforms::beginFrame(int numRows, int numCols, float angleDegrees)
+{
+    if (numRows != rows || numCols != cols)
+    {
+        rows = numRows;
+        cols = numCols;
+        translations.resize(rows * cols);
+        for (int i = 0; i < rows; ++i)
+        {
+            for (int j = 0; j < cols; ++j)
+            {
+                double xt, yt;
+                CellTranslation(rows, cols, i, j, xt, yt);
+                translations[i * cols + j] = glm::vec3(xt, yt, -10.f);
+            }
+        }
+    }
+
+    rotation = glm::rotate(glm::mat4(1.f), glm::radians(angleDegrees), glm::vec3(0, 1, 0));
+}
+
+const glm::mat4& OrthoMatrix()
+{
+    static const glm::mat4 orthoMat = glm::ortho(-10.f, 10.f, -10.f, 10.f, -20.f, 20.f);
+    return orthoMat;
+}
+
+namespace
+{
+
+float maxAbsDifference(const glm::mat4& a, const glm::mat4& b)
+{
+    float d = 0;
+    for (int c = 0; c < 4; ++c)
+    {
+        for (int r = 0; r < 4; ++r)
+        {
+            d = max(d, fabs(a[c][r] - b[c][r]));
+        }
+    }
+    return d;
+}
+
+} // namespace
+
+void BenchmarkTransforms()
+{
+    const int sizes[] = { 10, 50, 100, 500 };
+    const int frames = 50;
+    const float s = 0.45f;
+
+    printf("   grid   per-cell inverse us/frame   cached us/frame   speedup   max |diff|\n");
+    for (int n : sizes)
+    {
+        float sink = 0, maxDiff = 0;
+        float angle = 0;
+
+        auto start = chrono::steady_clock::now();
+        for (int f = 0; f < frames; ++f, angle += 0.5f)
+        {
+            for (int i = 0; i < n; ++i)
+            {
+                for (int j = 0; j < n; ++j)
+                {
+                    // what display() used to do for every cell
+                    double xt = (j)*(20./n)-10+1.5;
+                    double yt = 10-i*(20./n)-1.5;
+                    glm::mat4 T = glm::translate(glm::mat4(1.f), glm::vec3(xt, yt, -10.f));
+                    glm::mat4 R = glm::rotate(glm::mat4(1.f), glm::radians(angle), glm::vec3(0, 1, 0));
+                    glm::mat4 S = glm::scale(glm::mat4(1.f), glm::vec3(s, s, s));
+                    glm::mat4 modelMat = T * R * S;
+                    glm::mat4 modelMatInv = glm::transpose(glm::inverse(modelMat));
+                    glm::mat4 perspMat = glm::perspective(glm::radians(45.0f), 1.f, 1.f, 100.0f);
+                    glm::mat4 orthoMat = glm::ortho(-10.f, 10.f, -10.f, 10.f, -20.f, 20.f);
+                    sink += modelMat[3][0] + modelMatInv[0][0] + perspMat[0][0] + orthoMat[0][0];
+                }
+            }
+        }
+        double oldUs = chrono::duration<double, micro>(chrono::steady_clock::now() - start).count() / frames;
+
+        BoardTransforms transforms;
+        angle = 0;
+        start = chrono::steady_clock::now();
+        for (int f = 0; f < frames; ++f, angle += 0.5f)
+        {
+            transforms.beginFrame(n, n, angle);
+            const glm::mat4& orthoMat = OrthoMatrix();
+            for (int i = 0; i < n; ++i)
+            {
+                for (int j = 0; j < n; ++j)
+                {
+                    glm::mat4 modelMat = transforms.model(i, j, s);
+                    glm::mat4 modelMatInv = NormalMatrix(modelMat);
+                    sink += modelMat[3][0] + modelMatInv[0][0] + orthoMat[0][0];
+                }
+            }
+        }
+        double newUs = chrono::duration<double, micro>(chrono::steady_clock::now() - start).count() / frames;
+
+        // both ways must agree
+        for (int i = 0; i < n; ++i)
+        {
+            for (int j = 0; j < n; ++j)
+            {
+                glm::mat4 T = glm::translate(glm::mat4(1.f), transforms.translation(i, j));
+                glm::mat4 S = glm::scale(glm::mat4(1.f), glm::vec3(s, s, s));
+                glm::mat4 modelMat = T * transforms.rotation * S;
+                maxDiff = max(maxDiff, maxAbsDifference(modelMat, transforms.model(i, j, s)));
+                maxDiff = max(maxDiff, maxAbsDifference(glm::transpose(glm::inverse(modelMat)), NormalMatrix(modelMat)));
+            }
+        }
+
+        printf("%4dx%-4d %27.1f %17.1f %9.2f %12.2g%s\n", n, n, oldUs, newUs, oldUs / newUs, maxDiff,
+               sink == 12345.f ? " " : ""); // keeps sink alive
+    }
+}
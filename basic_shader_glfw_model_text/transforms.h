@@ -0,0 +1,70 @@
+#ifndef TRANSFORMS_H
+#define TRANSFORMS_H
+
+#include <vector>
+#include <glm/glm.hpp>
+
+/// Where the center of cell (i, j) of a rows x cols board is, in world space.
+/// The projection maps [-10, 10] on x and y to the whole window.
+void CellTranslation(int rows, int cols, int i, int j, double& xt, double& yt);
+
+/// The cell whose center is nearest to window position (x, y) (origin top
+/// left, as GLFW reports the cursor) in a width x height window, if the
+/// position is within 15 pixels of it on both axes. Constant time.
+bool PickCell(int rows, int cols, int width, int height, double x, double y, int& i, int& j);
+
+/// Model matrices of the board cells. Every cell is T(cell) * R(angle) * S(s)
+/// with a uniform scale s, so only the translation differs between cells.
+/// Translations are computed once per board layout, the rotation once per frame.
+struct BoardTransforms
+{
+    int rows = 0, cols = 0;
+    std::vector<glm::vec3> translations; // row-major
+    glm::mat4 rotation = glm::mat4(1.f);
+
+    /// Recomputes the translations if the layout changed and the shared rotation
+    void beginFrame(int numRows, int numCols, float angleDegrees);
+
+    const glm::vec3& translation(int i, int j) const { return translations[i * cols + j]; }
+
+    /// T * R * S for cell (i, j) and uniform scale s. The instanced shaders
+    /// transform normals with this too instead of NormalMatrix: with a
+    /// uniform scale the two differ only in the length of the normal,
+    /// which the shaders normalize.
+    glm::mat4 model(int i, int j, float s) const
+    {
+        glm::mat4 m;
+        m[0] = rotation[0] * s;
+        m[1] = rotation[1] * s;
+        m[2] = rotation[2] * s;
+        m[3] = glm::vec4(translation(i, j), 1.f);
+        return m;
+    }
+};
+
+/// transpose(inverse(model)) for a model matrix built by BoardTransforms::model.
+/// With M = [sR t], the inverse transpose is [R/s t'] where t' = -(R^T t)/s
+/// ends up in the bottom row. The scale must not be 0.
+inline glm::mat4 NormalMatrix(const glm::mat4& model)
+{
+    glm::vec3 t(model[3].x, model[3].y, model[3].z);
+    glm::vec4 c0 = model[0], c1 = model[1], c2 = model[2];
+    float invS2 = 1.f / glm::dot(glm::vec3(c0.x, c0.y, c0.z), glm::vec3(c0.x, c0.y, c0.z));
+
+    glm::mat4 n;
+    n[0] = glm::vec4(c0.x * invS2, c0.y * invS2, c0.z * invS2, -glm::dot(glm::vec3(c0.x, c0.y, c0.z), t) * invS2);
+    n[1] = glm::vec4(c1.x * invS2, c1.y * invS2, c1.z * invS2, -glm::dot(glm::vec3(c1.x, c1.y, c1.z), t) * invS2);
+    n[2] = glm::vec4(c2.x * invS2, c2.y * invS2, c2.z * invS2, -glm::dot(glm::vec3(c2.x, c2.y, c2.z), t) * invS2);
+    n[3] = glm::vec4(0.f, 0.f, 0.f, 1.f);
+    return n;
+}
+
+/// Projection shared by all board shaders; it never changes
+const glm::mat4& OrthoMatrix();
+
+/// Times building every cell's model and normal matrix of a few board sizes
+/// the old way (translate/rotate/scale and a general inverse per cell) and
+/// with BoardTransforms, and prints the CPU time per frame of both.
+void BenchmarkTransforms();
+
+#endif
@@ -11,21 +11,28 @@ vec3 kd = vec3(0.7, 0, 0.2);
 vec3 ka = vec3(0.1, 0.1, 0.1);
 vec3 ks = vec3(0.8, 0.8, 0.8);
 
+#ifdef INSTANCED
+attribute mat4 modelingMat; // per instance
+#define normalMat modelingMat
+#else
 uniform mat4 modelingMat;
 uniform mat4 modelingMatInvTr;
+#define normalMat modelingMatInvTr
+#endif
 uniform mat4 orthoMat;
 
-attribute vec3 inVertex;
-attribute vec3 inNormal;
+// inVertex and inNormal come with vertex_format.glsl
 
 void main(void)
 {
-	vec4 p = modelingMat * vec4(inVertex, 1); // translate to world coordinates
+	vec3 position = decodePosition();
+	vec3 normal = decodeNormal();
+	vec4 p = modelingMat * vec4(position, 1); // translate to world coordinates
 	vec3 Lorg = lightPos - vec3(p);
 	vec3 L = normalize(Lorg);
 	vec3 V = normalize(eyePos - vec3(p));
 	vec3 H = normalize(L + V);
-	vec3 N = vec3(modelingMatInvTr * vec4(inNormal, 0)); // provided by the programmer
+	vec3 N = vec3(normalMat * vec4(normal, 0)); // provided by the programmer
 	N = normalize(N);
 	float NdotL = dot(N, L);
 	float NdotH = dot(N, H);
@@ -37,6 +44,6 @@ void main(void)
 
 	gl_FrontColor = vec4(diffuseColor + ambientColor + specularColor, 1);
 
-    gl_Position = orthoMat * modelingMat * vec4(inVertex, 1);
+    gl_Position = orthoMat * modelingMat * vec4(position, 1);
 }
 
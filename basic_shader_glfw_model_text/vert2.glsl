@@ -1,10 +1,15 @@
 #version 120 
 
-attribute vec3 inVertex;
-attribute vec3 inNormal;
+// inVertex and inNormal come with vertex_format.glsl
 
+#ifdef INSTANCED
+attribute mat4 modelingMat; // per instance
+#define normalMat modelingMat
+#else
 uniform mat4 modelingMat;
 uniform mat4 modelingMatInvTr;
+#define normalMat modelingMatInvTr
+#endif
 uniform mat4 orthoMat;
 
 varying vec4 fragPos;
@@ -12,13 +17,15 @@ varying vec3 N;
 
 void main(void)
 {
+	vec3 position = decodePosition();
+	vec3 normal = decodeNormal();
 
-	vec4 p = modelingMat * vec4(inVertex, 1); // translate to world coordinates
-	vec3 Nw = vec3(modelingMatInvTr * vec4(inNormal, 0)); // provided by the programmer
+	vec4 p = modelingMat * vec4(position, 1); // translate to world coordinates
+	vec3 Nw = vec3(normalMat * vec4(normal, 0)); // provided by the programmer
 
 	N = normalize(Nw);
 	fragPos = p;
 
-    gl_Position = orthoMat * modelingMat * vec4(inVertex, 1);
+    gl_Position = orthoMat * modelingMat * vec4(position, 1);
 }
 
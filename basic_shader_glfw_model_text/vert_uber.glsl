@@ -0,0 +1,29 @@
+#version 120 
+
+// Materials and shadeVertex() come with material.glsl,
+// inVertex and inNormal with vertex_format.glsl
+
+#ifdef INSTANCED
+attribute mat4 modelingMat;       // per instance
+attribute float instanceMaterial; // per instance
+#define normalMat modelingMat
+#define cellMaterial int(instanceMaterial + 0.5)
+#else
+uniform int materialId;
+uniform mat4 modelingMat;
+uniform mat4 modelingMatInvTr;
+#define normalMat modelingMatInvTr
+#define cellMaterial materialId
+#endif
+uniform mat4 orthoMat;
+
+void main(void)
+{
+	vec3 position = decodePosition();
+	vec3 normal = decodeNormal();
+
+	vec4 p = modelingMat * vec4(position, 1); // translate to world coordinates
+	shadeVertex(cellMaterial, p, vec3(normalMat * vec4(normal, 0)));
+
+    gl_Position = orthoMat * p;
+}
@@ -0,0 +1,142 @@
+#include "vertex_format.h"
+
+#include <algorithm>
+#include <cmath>
+#include "mesh_cache.h"
+
+using namespace std;
+
+namespace
+{
+
+inline float signNotZero(float x) { return x >= 0 ? 1.f : -1.f; }
+
+/// Same as decodeNormal() in vertex_format.glsl. Normalized GL_SHORT
+/// attributes are c / 32767 since GL 4.2; older drivers map c to
+/// (2c + 1) / 65535 instead, which is off by less than 2e-5.
+void decodeNormal(const GLshort packed[2], float n[3])
+{
+    float u = max(packed[0] / 32767.f, -1.f);
+    float v = max(packed[1] / 32767.f, -1.f);
+    n[0] = u;
+    n[1] = v;
+    n[2] = 1 - fabs(u) - fabs(v);
+    if (n[2] < 0)
+    {
+        n[0] = (1 - fabs(v)) * signNotZero(u);
+        n[1] = (1 - fabs(u)) * signNotZero(v);
+    }
+    float length = sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+    for (int k = 0; k < 3; ++k) n[k] /= length;
+}
+
+/// Projects n onto the octahedron |x| + |y| + |z| = 1 and unfolds the lower
+/// half over the diagonals. Of the four ways to round the result to 16 bits
+/// it keeps the one that decodes closest to n.
+void encodeNormal(const GLfloat n[3], GLshort packed[2])
+{
+    float l1 = fabs(n[0]) + fabs(n[1]) + fabs(n[2]);
+    if (l1 == 0)
+    {
+        packed[0] = packed[1] = 0;
+        return;
+    }
+    float u = n[0] / l1, v = n[1] / l1;
+    if (n[2] < 0)
+    {
+        float unfoldedU = (1 - fabs(v)) * signNotZero(u);
+        v = (1 - fabs(u)) * signNotZero(v);
+        u = unfoldedU;
+    }
+
+    float best = -2;
+    float scaledU = u * 32767, scaledV = v * 32767;
+    for (float cu : { floor(scaledU), ceil(scaledU) })
+    {
+        for (float cv : { floor(scaledV), ceil(scaledV) })
+        {
+            GLshort candidate[2] = { (GLshort) cu, (GLshort) cv };
+            float decoded[3];
+            decodeNormal(candidate, decoded);
+            float cosine = decoded[0] * n[0] + decoded[1] * n[1] + decoded[2] * n[2];
+            if (cosine > best)
+            {
+                best = cosine;
+                packed[0] = candidate[0];
+                packed[1] = candidate[1];
+            }
+        }
+    }
+}
+
+} // namespace
+
+void PackVertices(const GpuMesh& mesh, vector<PackedVertex>& packed, PositionDecode& decode)
+{
+    for (int k = 0; k < 3; ++k)
+    {
+        decode.offset[k] = mesh.bboxMin[k];
+        decode.scale[k] = mesh.bboxMax[k] - mesh.bboxMin[k];
+    }
+
+    packed.resize(mesh.vertexCount);
+    for (GLsizei i = 0; i < mesh.vertexCount; ++i)
+    {
+        const GLfloat* v = mesh.vertexData + 6 * i;
+        PackedVertex& p = packed[i];
+        for (int k = 0; k < 3; ++k)
+        {
+            float fraction = decode.scale[k] > 0 ? (v[k] - decode.offset[k]) / decode.scale[k] : 0;
+            p.position[k] = (GLushort) lround(min(max(fraction, 0.f), 1.f) * 65535);
+        }
+        p.position[3] = 0;
+        encodeNormal(v + 3, p.normal);
+    }
+}
+
+PackingError MeasurePackingError(const GpuMesh& mesh, const vector<PackedVertex>& packed,
+                                 const PositionDecode& decode)
+{
+    PackingError error;
+    double positionSum = 0, normalSum = 0;
+    int normals = 0;
+
+    for (int k = 0; k < 3; ++k)
+    {
+        error.bboxDiagonal += (double) decode.scale[k] * decode.scale[k];
+    }
+    error.bboxDiagonal = sqrt(error.bboxDiagonal);
+
+    for (GLsizei i = 0; i < mesh.vertexCount; ++i)
+    {
+        const GLfloat* v = mesh.vertexData + 6 * i;
+        const PackedVertex& p = packed[i];
+
+        double squared = 0;
+        for (int k = 0; k < 3; ++k)
+        {
+            double decoded = decode.offset[k] + p.position[k] / 65535.0 * decode.scale[k];
+            squared += (decoded - v[k]) * (decoded - v[k]);
+        }
+        double distance = sqrt(squared);
+        error.maxPosition = max(error.maxPosition, distance);
+        positionSum += distance;
+
+        // normals the OBJ left out (or degenerate ones) have no direction to keep
+        double length = sqrt((double) v[3] * v[3] + (double) v[4] * v[4] + (double) v[5] * v[5]);
+        if (length > 0)
+        {
+            float n[3];
+            decodeNormal(p.normal, n);
+            double cosine = (n[0] * v[3] + n[1] * v[4] + n[2] * v[5]) / length;
+            double degrees = acos(min(max(cosine, -1.0), 1.0)) * 180 / M_PI;
+            error.maxNormalDegrees = max(error.maxNormalDegrees, degrees);
+            normalSum += degrees;
+            ++normals;
+        }
+    }
+
+    if (mesh.vertexCount > 0) error.meanPosition = positionSum / mesh.vertexCount;
+    if (normals > 0) error.meanNormalDegrees = normalSum / normals;
+    return error;
+}
@@ -0,0 +1,36 @@
+// Inserted by createVS after the #version line of every board vertex shader.
+// PACKED_VERTICES is defined when the mesh was uploaded as PackedVertex.
+
+#ifdef PACKED_VERTICES
+
+attribute vec3 inVertex; // fraction of the bounding box, 16-bit unorm
+attribute vec2 inNormal; // octahedral, 16-bit snorm
+
+uniform vec3 positionOffset;
+uniform vec3 positionScale;
+
+vec3 decodePosition()
+{
+	return positionOffset + inVertex * positionScale;
+}
+
+vec3 decodeNormal()
+{
+	vec3 n = vec3(inNormal, 1.0 - abs(inNormal.x) - abs(inNormal.y));
+	if (n.z < 0.0)
+	{
+		vec2 s = vec2(inNormal.x >= 0.0 ? 1.0 : -1.0, inNormal.y >= 0.0 ? 1.0 : -1.0);
+		n.xy = (1.0 - abs(inNormal.yx)) * s;
+	}
+	return normalize(n);
+}
+
+#else
+
+attribute vec3 inVertex;
+attribute vec3 inNormal;
+
+vec3 decodePosition() { return inVertex; }
+vec3 decodeNormal() { return inNormal; }
+
+#endif
@@ -0,0 +1,48 @@
+#ifndef VERTEX_FORMAT_H
+#define VERTEX_FORMAT_H
+
+#include <vector>
+#include <GL/glew.h>
+
+struct GpuMesh;
+
+/// Compact form of one GpuMesh vertex, 12 bytes instead of 24:
+///  - position as 16-bit unsigned normalized fractions of the bounding box,
+///    padded to 8 bytes so the normal stays 4-byte aligned
+///  - normal octahedral-mapped to two 16-bit signed normalized values
+/// Both are plain normalized GL_UNSIGNED_SHORT/GL_SHORT attributes, so they
+/// work in the GL 2.1 context; vertex_format.glsl decodes them.
+struct PackedVertex
+{
+    GLushort position[4]; // x y z, padding
+    GLshort normal[2];
+};
+
+/// Where the normal starts within a PackedVertex
+const size_t kPackedNormalOffset = 4 * sizeof(GLushort);
+
+/// What the shaders need to turn a packed position back into object space:
+/// position = offset + fraction * scale
+struct PositionDecode
+{
+    GLfloat offset[3] = {0, 0, 0};
+    GLfloat scale[3] = {0, 0, 0};
+};
+
+/// Packs the vertices of mesh relative to its bounding box
+void PackVertices(const GpuMesh& mesh, std::vector<PackedVertex>& packed, PositionDecode& decode);
+
+/// Difference between the mesh and its packed vertices as the shaders decode them
+struct PackingError
+{
+    double maxPosition = 0;    // object space units
+    double meanPosition = 0;
+    double bboxDiagonal = 0;   // to put the position error in proportion
+    double maxNormalDegrees = 0;
+    double meanNormalDegrees = 0;
+};
+
+PackingError MeasurePackingError(const GpuMesh& mesh, const std::vector<PackedVertex>& packed,
+                                 const PositionDecode& decode);
+
+#endif